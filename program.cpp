@@ -4,563 +4,3967 @@
 #include <iostream>
 #include <algorithm>
 #include <queue>
+#include <deque>
+#include <thread>
+#include <atomic>
+#include <tuple>
+#include <functional>
+#include <set>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <cctype>
+#include <cmath>
+#include <csignal>
+#include <chrono>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 using namespace std;
 
 /*
-Process struct. Holds each process arrival time, burst time, remaining time, nice level, 
-index for tie-breaks, and performance metrics.
+Bump allocator that hands out 64-byte aligned arrays. Everything allocated for a test case is
+released at once by reset(), and the memory is kept for the next test case. If a test case needed
+more than one block, reset() merges them into a single block of the combined size, so after the
+first few test cases everything comes from one contiguous allocation.
 */
-struct Process{
-    int id;
-    int arrival;
-    int burst;
-    int remaining;
-    int nice;
-    int start_time = -1;
-    int completion_time = 0;
-    int waiting_time = 0;
-    int turnaround_time = 0;
-    int response_time = 0;
-    
-    Process(int id, int arrival, int burst, int nice){
-        this->id = id;
-        this->arrival = arrival;
-        this->burst = burst;
-        this->remaining = burst;
-        this->nice = nice;
+struct Arena {
+    static const size_t ALIGN = 64;
+    static const size_t MIN_BLOCK = 1 << 16;
+    vector<char*> blocks;
+    vector<size_t> blockSizes;
+    size_t used;   // bytes used in the last block
+
+    Arena(){
+        this->used = 0;
+    }
+
+    ~Arena(){
+        for (char* block : blocks){
+            free(block);
+        }
+    }
+
+    // A new block, or the end of the program if there is no memory for it.
+    static char* block(size_t size){
+        char* b = (char*)aligned_alloc(ALIGN, size);
+        if (b == nullptr){
+            cerr << "out of memory: cannot allocate " << size << " bytes for a test case" << endl;
+            exit(1);
+        }
+        return b;
+    }
+
+    template <typename T>
+    T* allocate(size_t count){
+        size_t bytes = (count * sizeof(T) + ALIGN - 1) & ~(ALIGN - 1);
+        if (blocks.empty() || used + bytes > blockSizes.back()){
+            size_t size = max(bytes, blocks.empty() ? MIN_BLOCK : 2 * blockSizes.back());
+            blocks.push_back(block(size));
+            blockSizes.push_back(size);
+            used = 0;
+        }
+        T* result = (T*)(blocks.back() + used);
+        used += bytes;
+        return result;
+    }
+
+    void reset(){
+        if (blocks.size() > 1){
+            size_t total = 0;
+            for (size_t b = 0; b < blocks.size(); b++){
+                total += blockSizes[b];
+                free(blocks[b]);
+            }
+            blocks.assign(1, block(total));
+            blockSizes.assign(1, total);
+        }
+        used = 0;
+    }
+};
+
+/*
+Type of every time and burst value, in the process table and in all the engines. 32-bit by default,
+which keeps the hot arrays dense; build with -DSCHED_TIME_BITS=64 for inputs whose clock runs past
+2^31 - 1 ns (about 2.1 s), such as day-long traces. The parser refuses a test case whose clock
+could overflow the type (see TimeSpan).
+*/
+#ifndef SCHED_TIME_BITS
+#define SCHED_TIME_BITS 32
+#endif
+#if SCHED_TIME_BITS == 64
+typedef long long Time;
+const Time TIME_MIN = LLONG_MIN;
+const Time TIME_MAX = LLONG_MAX;
+#elif SCHED_TIME_BITS == 32
+typedef int Time;
+const Time TIME_MIN = INT_MIN;
+const Time TIME_MAX = INT_MAX;
+#else
+#error "SCHED_TIME_BITS must be 32 or 64"
+#endif
+
+/*
+Bound on the clock of a test case, built up while it is parsed. No simulation runs past
+max(0, latest arrival) + total burst, and no turnaround is larger than that minus
+min(0, earliest arrival), so when that fits in Time nothing overflows.
+*/
+struct TimeSpan {
+    long long earliest = 0;
+    long long latest = 0;
+    long long totalBurst = 0;
+
+    // Adds a process; false if the clock could now overflow Time.
+    bool add(long long arrival, long long burst){
+        earliest = min(earliest, arrival);
+        latest = max(latest, arrival);
+        long long span;
+        return !__builtin_add_overflow(totalBurst, burst, &totalBurst)
+            && !__builtin_add_overflow(latest - earliest, totalBurst, &span) && span <= TIME_MAX;
+    }
+};
+
+// The parser's message for a test case that fails TimeSpan::add.
+string timeOverflow(int testNumber){
+    return "test case " + to_string(testNumber) + " can run past the largest time of " + to_string(TIME_MAX) + "ns"
+        + (SCHED_TIME_BITS == 32 ? ", build with -DSCHED_TIME_BITS=64 for longer runs" : "");
+}
+
+/*
+Process table in structure-of-arrays form. Process i (0-based, in input order) has id i+1.
+The fields the schedulers read on every decision (arrival, burst, remaining, nice) are kept in
+their own arrays, apart from the metrics, which are only written when a process starts or
+finishes and read by printResults.
+*/
+struct ProcessTable {
+    int size;
+    // hot fields
+    Time* arrival;
+    Time* burst;
+    Time* remaining;
+    int* nice;
+    // metrics
+    Time* start_time;
+    Time* completion_time;
+    Time* waiting_time;
+    Time* turnaround_time;
+    Time* response_time;
+
+    void allocate(int size, Arena& arena){
+        this->size = size;
+        arrival = arena.allocate<Time>(size);
+        burst = arena.allocate<Time>(size);
+        remaining = arena.allocate<Time>(size);
+        nice = arena.allocate<int>(size);
+        start_time = arena.allocate<Time>(size);
+        completion_time = arena.allocate<Time>(size);
+        waiting_time = arena.allocate<Time>(size);
+        turnaround_time = arena.allocate<Time>(size);
+        response_time = arena.allocate<Time>(size);
+    }
+
+    // Points the input fields at those of another table and allocates fresh state and metrics,
+    // so several simulations of the same processes can run at once.
+    void share(const ProcessTable& input, Arena& arena){
+        this->size = input.size;
+        arrival = input.arrival;
+        burst = input.burst;
+        nice = input.nice;
+        remaining = arena.allocate<Time>(size);
+        start_time = arena.allocate<Time>(size);
+        completion_time = arena.allocate<Time>(size);
+        waiting_time = arena.allocate<Time>(size);
+        turnaround_time = arena.allocate<Time>(size);
+        response_time = arena.allocate<Time>(size);
+        for (int i = 0; i < size; i++){
+            remaining[i] = burst[i];
+            start_time[i] = -1;
+            completion_time[i] = 0;
+        }
     }
+
+    void set(int i, Time arrival, Time burst, int nice){
+        this->arrival[i] = arrival;
+        this->burst[i] = burst;
+        this->remaining[i] = burst;
+        this->nice[i] = nice;
+        this->start_time[i] = -1;
+        this->completion_time[i] = 0;
+    }
+
+    int id(int i) const {
+        return i + 1;
+    }
+};
+
+// A --what-if change: process `process` of test case `test` gets `value` as its burst or nice level.
+struct WhatIf {
+    int test;
+    int process;
+    string field;   // "burst" or "nice"
+    int value;
+};
+
+/*
+Settings that come from the command line rather than the input, the same for every test case.
+*/
+struct SimOptions {
+    int cpus = 1;               // simulated CPUs, anything above 1 is handled by runSMP
+    int cfsLatency = 6000000;   // CFS target latency in ns, Linux's default of 6ms
+    int cfsGranularity = 750000; // CFS minimum granularity in ns, Linux's default of 0.75ms
+    int mlfqLevels = 3;
+    vector<int> mlfqQuanta = {10, 20, 40};   // per level, the last one doubles for deeper levels
+    int mlfqBoost = 1000;       // priority boost period in ns, 0 for none
+    bool summary = false;       // percentiles instead of the per-process lists
+    vector<WhatIf> whatIf;      // changes to re-simulate from checkpoints, see runWhatIf
+    bool gantt = true;          // Gantt chart output, see GanttWriter
+    bool ganttMerge = false;
+    long long ganttSample = 1;
+    long long ganttCap = LLONG_MAX;
+};
+
+#ifndef SCHED_STATS
+#define SCHED_STATS 1
+#endif
+
+/*
+Instrumentation counters of one test case, reported by --stats. The run* functions update them
+through the STAT_* macros below; building with -DSCHED_STATS=0 turns the macros into nothing, so
+not a single counting instruction or clock read is left in the simulation loops (the struct stays
+so that signatures do not change, and --stats is refused).
+Pushes, pops, preemptions (a running process stopped before it finished, including RR quantum
+expiries) and context switches (a CPU picking a different process than the last one it ran) are
+counted as they happen. Idle jumps are the times the clock skipped over idle time.
+*/
+struct Stats {
+    long long pushes = 0;
+    long long pops = 0;
+    long long preemptions = 0;
+    long long switches = 0;
+    long long segments = 0;     // Gantt lines
+    long long idleJumps = 0;
+    long long idleTime = 0;
+    long long parseNs = 0;
+    long long runNs = 0;        // the whole run* call, printResults included
+    long long printNs = 0;      // printResults
+    long long flushNs = 0;      // writing the test case's output
+    long long lastRun = -1;     // process that ran last, for switches
 };
 
+#if SCHED_STATS
+#define STAT_ADD(stats, field, n) ((stats).field += (n))
+#define STAT_SWITCH(stats, p) ((stats).switches += ((stats).lastRun != (p)), (stats).lastRun = (p))
+#define STAT_TIME(stats, field, ...) do { \
+        auto statStart = chrono::steady_clock::now(); \
+        __VA_ARGS__; \
+        (stats).field += chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - statStart).count(); \
+    } while (0)
+#else
+// stats is still named, so a Stats& parameter only used through the macros does not warn as unused
+#define STAT_ADD(stats, field, n) ((void)(stats))
+#define STAT_SWITCH(stats, p) ((void)(stats))
+#define STAT_TIME(stats, field, ...) do { __VA_ARGS__; } while (0)
+#endif
+
+struct GanttTrace;
+struct Snapshotter;
+
 /*
 Test Case struct used to keep track of each test cases.
+A TestCase is meant to be reused: reset() starts a new test case in the same arena, so the
+process table and any scratch arrays the run* functions need come from memory that was
+already allocated for the previous one.
 */
 struct TestCase {
     string algorithm;
-    int quantum;
-    Process** processes; 
+    Time quantum;
+    // RR quantum sweep "quantum..quantumLast step quantumStep", quantumStep is 0 without one.
+    Time quantumLast;
+    Time quantumStep;
     int size;
-    
-    TestCase(int size, string algorithm){
+    Arena arena;
+    ProcessTable procs;
+    // Number of times the scheduler picked a process to run, used by the benchmarks.
+    long long decisions;
+    SimOptions options;
+    // Where Gantt segments go with --trace, nullptr for the usual text lines.
+    GanttTrace* trace;
+    // Takes --snapshot snapshots while the test case runs, nullptr without.
+    Snapshotter* snapshots;
+    Stats stats;
+    // Process indices by (arrival, id), nullptr until sortedByArrival computes it.
+    int* arrivalOrder;
+    // Clock bound of the parsed processes, checked again when --what-if changes a burst.
+    TimeSpan span;
+
+    TestCase(){
+        this->quantum = 0;
+        this->quantumLast = 0;
+        this->quantumStep = 0;
+        this->size = 0;
+        this->decisions = 0;
+        this->trace = nullptr;
+        this->snapshots = nullptr;
+        this->arrivalOrder = nullptr;
+    }
+
+    void reset(int size, const string& algorithm){
         this->quantum = 0;
+        this->quantumLast = 0;
+        this->quantumStep = 0;
         this->algorithm = algorithm;
         this->size = size;
-        processes = new Process*[size];
-    }
-    
-    void addProcess(int idx, Process* proc){
-        processes[idx] = proc;
+        this->decisions = 0;
+        this->stats = Stats();
+        this->arrivalOrder = nullptr;
+        this->span = TimeSpan();
+        arena.reset();
+        procs.allocate(size, arena);
     }
-    
-    ~TestCase(){
-        for (int i = 0; i < size; i++){
-            delete processes[i];
-        }
-        delete[] processes;
+
+    // Starts another simulation of input's processes, sharing its input arrays (see ProcessTable::share).
+    void resetFrom(const TestCase& input){
+        this->quantum = input.quantum;
+        this->quantumLast = 0;
+        this->quantumStep = 0;
+        this->algorithm = input.algorithm;
+        this->size = input.size;
+        this->decisions = 0;
+        this->stats = Stats();
+        this->options = input.options;
+        // the arrival order only depends on the shared arrivals, so it is shared too
+        this->arrivalOrder = input.arrivalOrder;
+        this->span = input.span;
+        arena.reset();
+        procs.share(input.procs, arena);
     }
 };
 
-void printResults(int testNumber, TestCase* tc) {
-    int n = tc->size;
-    Process** processes = tc->processes;
+/*
+Output writer used by printResults and every run* function. Numbers are formatted straight into
+one reusable buffer, which is written to the file descriptor with write() once it fills up or when
+flush() is called at the end of a test case, instead of flushing stdout on every line.
+Doubles use "%g", which is the same format cout uses by default.
+An Output built with fd = Output::MEMORY never writes anything; its buffer grows instead so the
+contents can be handed to another Output later (used by the --jobs workers). One built with
+fd = Output::DISCARD drops whatever it is given.
+*/
+struct Output {
+    static const size_t CAPACITY = 1 << 20;
+    static const int MEMORY = -1;
+    static const int DISCARD = -2;
+    int fd;
+    char* buffer;
+    size_t size;
+    size_t capacity;
 
-    // Compute metrics for each process
-    int totalBurst = 0;
-    int totalTime = 0;
-    for (int i = 0; i < n; i++){
-        Process* p = processes[i];
-        p->turnaround_time = p->completion_time - p->arrival;
-        p->waiting_time    = p->turnaround_time - p->burst;
-        p->response_time   = p->start_time - p->arrival;
-        totalBurst += p->burst;
-        if (p->completion_time > totalTime){
-            totalTime = p->completion_time;   
+    Output(int fd, size_t capacity = CAPACITY){
+        this->fd = fd;
+        this->buffer = (char*)malloc(capacity);
+        this->size = 0;
+        this->capacity = capacity;
+    }
+
+    ~Output(){
+        flush();
+        free(buffer);
+    }
+
+    static void writeAll(int fd, const char* data, size_t len){
+        size_t written = 0;
+        while (written < len){
+            ssize_t r = ::write(fd, data + written, len - written);
+            if (r < 0){
+                if (errno == EINTR) continue;
+                perror("write");
+                exit(1);
+            }
+            written += r;
         }
     }
 
-    int cpuUtil = (int)((double)totalBurst / totalTime * 100);
-    double throughput = (double)n / totalTime;
+    void flush(){
+        if (fd == MEMORY) return;
+        if (fd != DISCARD){
+            writeAll(fd, buffer, size);
+        }
+        size = 0;
+    }
 
-    cout << "Total time elapsed: " << totalTime << "ns" << endl;
-    cout << "Total CPU burst time: " << totalBurst << "ns" << endl;
-    cout << "CPU Utilization: " << cpuUtil << "%" << endl;
-    cout << "Throughput: " << throughput << " processes/ns" << endl;
+    // Makes sure at least len more bytes fit in the buffer.
+    void reserve(size_t len){
+        if (size + len <= capacity) return;
+        if (fd != MEMORY){
+            flush();
+            if (len <= capacity) return;
+        }
+        while (size + len > capacity){
+            capacity *= 2;
+        }
+        buffer = (char*)realloc(buffer, capacity);
+    }
 
-    // Waiting times
-    double avgWait = 0;
-    cout << "Waiting times:" << endl;
-    for (int i = 0; i < n; i++){
-        cout << " Process " << processes[i]->id << ": " << processes[i]->waiting_time << "ns" << endl;
-        avgWait += processes[i]->waiting_time;
+    void write(const char* data, size_t len){
+        if (fd != MEMORY && len > capacity){
+            flush();
+            if (fd != DISCARD){
+                writeAll(fd, data, len);
+            }
+            return;
+        }
+        reserve(len);
+        memcpy(buffer + size, data, len);
+        size += len;
     }
-    avgWait /= n;
-    cout << "Average waiting time: " << avgWait << "ns" << endl;
 
-    // Turnaround times
-    double avgTurn = 0;
-    cout << "Turnaround times:" << endl;
-    for (int i = 0; i < n; i++){
-        cout << " Process " << processes[i]->id << ": " << processes[i]->turnaround_time << "ns" << endl;
-        avgTurn += processes[i]->turnaround_time;
+    void clear(){
+        size = 0;
     }
-    avgTurn /= n;
-    cout << "Average turnaround time: " << avgTurn << "ns" << endl;
 
-    // Response times
-    double avgResp = 0;
-    cout << "Response times:" << endl;
-    for (int i = 0; i < n; i++){
-        cout << " Process " << processes[i]->id << ": " << processes[i]->response_time << "ns" << endl;
-        avgResp += processes[i]->response_time;
+    Output& operator<<(const char* str){
+        write(str, strlen(str));
+        return *this;
     }
-    avgResp /= n;
-    cout << "Average response time: " << avgResp << "ns" << endl;
-}
 
-void runFCFS(int testNumber, TestCase* tc){
-    // Print the test number and algorithm name to match output for gantt "chart".
-    cout << testNumber << " " << tc->algorithm << endl;
-    int n = tc->size;
-    Process** processes = tc->processes;
-    
-    // Serves as something like an array to keep track of completed processes.
-    // Tracked by index (n) and becomes true once completed, this is updated at the end of the function.
-    vector<bool> done(n, false);
-    int completed = 0;
-    int currentTime= 0;
-    
-    // Main meat of the algorithm, it runs until all completed = n, meaning all processes have finished.
-    while (completed < n){
-        // Initialized as -1 for placeholder, this means that there is no process that has been chosen yet.
-        int chosenID = -1;
-        // Iterates over all processes.
-        for (int i = 0; i < n; i++){
-            if (done[i]) continue; // This just skips the process if it is already skipped.
-            if (processes[i]->arrival > currentTime) continue; // This just skips processes that have not yet arrived.
+    Output& operator<<(const string& str){
+        write(str.data(), str.size());
+        return *this;
+    }
 
-            if (chosenID == -1){
-                chosenID = i;
-            }
-            // In the case that there is a chosen process, it is compared with the ith process.
-            // Comparisons are: which process arrived first, and if they arrived at the same time, then who has a lower id.
-            else {
-                Process* chosen = processes[chosenID];
-                Process* ith = processes[i];
-                if (ith->arrival < chosen->arrival || ith->arrival == chosen->arrival && ith->id < chosen->id){
-                    chosenID = i;
-                }
-            }
+    Output& operator<<(char c){
+        reserve(1);
+        buffer[size++] = c;
+        return *this;
+    }
+
+    Output& operator<<(long long value){
+        reserve(24);
+        // Digits are produced backwards into a scratch area, then copied in order.
+        char digits[24];
+        int len = 0;
+        unsigned long long v = value < 0 ? 0ULL - (unsigned long long)value : value;
+        do {
+            digits[len++] = '0' + v % 10;
+            v /= 10;
+        } while (v != 0);
+        if (value < 0){
+            buffer[size++] = '-';
         }
-        
-        // Handles CPU being idle by skipping to the next time where a process arrives.
-        if (chosenID == -1){
-            int timeJump = INT_MAX;
-            // Iterates over all the processes and sets timeJump to the earliest arrival of a new process.
-            for (int i = 0; i < n; i++){
-                if (!done[i] && processes[i]->arrival < timeJump){
-                    timeJump = processes[i]->arrival;
-                }
-            }
-            currentTime = timeJump;
-            continue;
+        while (len > 0){
+            buffer[size++] = digits[--len];
         }
+        return *this;
+    }
 
-        // Process has finally been chosen by now, and so it starts to run now.
-        Process* p = processes[chosenID];
-        if (p->start_time == -1){
-            p->start_time = currentTime;
-        }
+    Output& operator<<(int value){
+        return *this << (long long)value;
+    }
 
-        // Output for gantt "chart".
-        cout << currentTime << " " << p->id << " " << p->burst << "X" << endl;
-        currentTime += p->burst;
-        p->remaining = 0;
-        p->completion_time = currentTime;
-        done[chosenID] = true;
-        completed ++;
+    Output& operator<<(double value){
+        reserve(32);
+        size += snprintf(buffer + size, 32, "%g", value);
+        return *this;
     }
-    printResults(testNumber, tc);
 };
 
-void runSRTF(int testNumber, TestCase* tc){
-    // Print the test number and algorithm name to match output for gantt "chart".
-    cout << testNumber << " " << tc->algorithm << endl;
-    int n = tc->size;
-    Process** processes = tc->processes;
-    
-    // Serves as something like an array to keep track of completed processes.
-    // Tracked by index (n) and becomes true once completed, this is updated at the end of the function.
-    vector<bool> done(n, false);
-    int completed = 0;
-    int currentTime= 0;
+/*
+Binary Gantt trace written with --trace FILE instead of the text Gantt lines, and turned back
+into them by the "trace FILE" mode. The file starts with the 8 bytes of MAGIC, followed by records
+made of LEB128 varints. The low 2 bits of a record's first varint give its kind, the rest a value:
+  0, 1  segment, 1 if the process finished: value = start - end of the previous segment,
+        zigzag-encoded, then the process id and the duration,
+  2     test case: value = test number, then the length and bytes of the algorithm name,
+  3     "CPU k:" heading of a --cpus run: value = k.
+Segments on one CPU never overlap, so the delta is normally a small gap; zigzag encoding keeps a
+negative one (a simulation whose clock overflowed) exact. A test case or CPU record starts the
+deltas again from 0. A typical segment takes 4 to 6 bytes.
+*/
+struct GanttTrace {
+    static constexpr const char* MAGIC = "GANTTv1\n";
+    Output data;
+    long long lastEnd;
 
-    // Main meat of the algorithm, it runs until all completed = n, meaning all processes have finished.
-    while (completed < n){
-        // Initialized as -1 for placeholder, this means that there is no process that has been chosen yet.
-        int chosenID = -1;
-        // Iterates over all processes.
-        for (int i = 0; i < n; i++){
-            if (done[i]) continue; // This just skips the process if it is already skipped.
-            if (processes[i]->arrival > currentTime) continue; // This just skips processes that have not yet arrived.
+    GanttTrace(int fd, size_t capacity = Output::CAPACITY) : data(fd, capacity){
+        this->lastEnd = 0;
+    }
 
-            if (chosenID == -1){
-                chosenID = i;
-            }
-            // In the case that there is a chosen process, it is compared with the ith process.
-            // Comparisons are: which process has shorter remaining time, and in the case of a tie, apply the fcfs logic.
-            else {
-                Process* chosen = processes[chosenID];
-                Process* ith = processes[i];
-                if (ith->remaining < chosen->remaining){
-                    chosenID = i;
-                }
-                else if (ith->remaining == chosen->remaining) {
-                    if (ith->arrival < chosen->arrival || ith->arrival == chosen->arrival && ith->id < chosen->id){
-                        chosenID = i;
-                    }
-                }
-            }
-        }
-        
-        // Handle CPU being idle by skipping to next time where a process arrives
-        if (chosenID == -1){
-            int timeJump = INT_MAX;
-            // Iterates over all the processes and sets timeJump to the earliest arrival of a new process.
-            for (int i = 0; i < n; i++){
-                if (!done[i] && processes[i]->arrival < timeJump){
-                    timeJump = processes[i]->arrival;
-                }
-            }
-            currentTime = timeJump;
-            continue;
+    void varint(unsigned long long value){
+        data.reserve(10);
+        while (value >= 0x80){
+            data.buffer[data.size++] = (char)(value | 0x80);
+            value >>= 7;
         }
+        data.buffer[data.size++] = (char)value;
+    }
 
-        // Process has finally been chosen by now, and so it starts to run now.
-        Process* p = processes[chosenID];
-        if (p->start_time == -1){
-            p->start_time = currentTime;
-        }
+    void header(){
+        data.write(MAGIC, 8);
+    }
 
-        // Duration the currently running process has until it terminates or is preempted.
-        int runUntil = currentTime + p->remaining;
+    void testCase(int testNumber, const string& algorithm){
+        varint((unsigned long long)testNumber << 2 | 2);
+        varint(algorithm.size());
+        data << algorithm;
+        lastEnd = 0;
+    }
 
-        for (int i = 0; i < n; i++){
-            if (done[i] || i == chosenID){
-                continue;
-            }
-            int incomingArrivalTime = processes[i]->arrival; // Save arrival time of currently selected process.
-            // Preemption happens here, conditional checker that ensures incoming process is actually new and will arrive while chosen process is running.
-            if (incomingArrivalTime > currentTime && incomingArrivalTime < runUntil){
-                int remainingAtArrival = p->remaining - (incomingArrivalTime - currentTime);
-                int incomingRemaining = processes[i]->remaining;
-                bool preempt = false;
-                if (incomingRemaining < remainingAtArrival){
-                    preempt = true;
-                }
-                else if (incomingRemaining == remainingAtArrival){
-                    if (processes[i]->arrival < p->arrival || processes[i]->arrival == p->arrival && processes[i]->id < p->id){
-                        preempt = true;
-                    }
-                }
-                if (preempt){
-                    runUntil = incomingArrivalTime;
-                }
-            }
-        }
+    void cpu(int c){
+        varint((unsigned long long)c << 2 | 3);
+        lastEnd = 0;
+    }
 
-        // Update the remaining time of the process currently running.
-        int runDuration = runUntil - currentTime;
-        p->remaining -= runDuration;
+    void segment(long long start, long long id, long long duration, bool finished){
+        long long delta = start - lastEnd;
+        varint(((unsigned long long)delta << 1 ^ (unsigned long long)(delta >> 63)) << 2 | finished);
+        varint(id);
+        varint(duration);
+        lastEnd = start + duration;
+    }
 
-        // Handles completed processes.
-        bool finished = (p->remaining == 0);
-        if (finished){
-            p->completion_time = currentTime + runDuration;
-            done[chosenID] = true;
-            completed ++;
-            cout << currentTime << " " << p->id << " " << runDuration << "X" << endl;
-        }
-        else {
-            cout << currentTime << " " << p->id << " " << runDuration << endl;
-        }
-        currentTime += runDuration;
+    // Appends the records of a trace that was built in memory.
+    void append(const GanttTrace& other){
+        data.write(other.data.buffer, other.data.size);
+        lastEnd = other.lastEnd;
     }
-    printResults(testNumber, tc);
-}
 
-struct _SJFcomp{
-    bool operator()(Process* a, Process*b){
-         if (a->burst != b->burst)
-            return a->burst > b->burst;
-        if (a->arrival != b->arrival)
-            return a->arrival > b->arrival;
-        return a->id > b->id;
+    // Writes out the records so far. Done after every test case, like the text output, so a run
+    // that stops on an input error leaves a trace of the test cases it printed.
+    void flush(){
+        data.flush();
     }
 };
 
-void runSJF(int testNumber, TestCase* tc){
-    cout << testNumber << " " << tc->algorithm << endl;
-    int n = tc->size;
-    Process** processes = tc->processes;
-    int completed=0;
-    int currentTime= 0;
-    int idx = 0;
+// Writes one Gantt segment: a "start pid duration" line, with X if the process finished, or a
+// record in the binary trace when there is one.
+void writeSegment(Output& out, GanttTrace* trace, long long start, long long id, long long duration, bool finished){
+    if (trace != nullptr){
+        trace->segment(start, id, duration, finished);
+        return;
+    }
+    out << start << " " << id << " " << duration;
+    if (finished){
+        out << 'X';
+    }
+    out << '\n';
+}
 
-    // sort processes by arrival time, ascending
-    sort(processes, processes +n, [](Process* a, Process*b){
-        if (a->arrival != b->arrival){
-            return a->arrival < b-> arrival;
-        } else{
-            return a->id < b->id;
-        }
-    });
+/*
+Gantt emission layer shared by every scheduler: the run* functions hand it each segment they
+decide and it chooses what reaches writeSegment.
+  --gantt-merge     adjacent segments of the same process (one starting where the other ended,
+                    the first one unfinished) become one, so the chart has one line per context
+                    switch instead of one per slice,
+  --gantt-sample K  only every K-th segment (after merging) is written, starting with the first,
+  --gantt-cap N     at most N segments per chart, then a "... K more segments" line,
+  --no-gantt        no segments at all.
+Without any of them every segment is written as is, which is the usual output. A merged segment
+is held back until the next one shows whether it continues; finish() writes it out at the end of
+the chart. The writer is plain data, so a copy of it is a checkpoint of the chart (see
+EngineCheckpoints).
+*/
+struct GanttWriter {
+    Output* out;
+    GanttTrace* trace;
+    bool plain;           // no option given, segments go straight to writeSegment
+    bool enabled;
+    bool merge;
+    long long sample;
+    long long cap;
+    bool pending;         // a merged segment is held back
+    long long start;
+    long long id;
+    long long duration;
+    bool finished;
+    long long seen;       // segments after merging
+    long long written;
 
-    // creates a priority queue to store the processes by burst time to simplify code
-    priority_queue<Process*, vector<Process*>, _SJFcomp> ready_queue;
+    GanttWriter(Output& out, GanttTrace* trace, const SimOptions& options){
+        this->out = &out;
+        this->trace = trace;
+        this->enabled = options.gantt;
+        this->merge = options.ganttMerge;
+        this->sample = options.ganttSample;
+        this->cap = options.ganttCap;
+        this->plain = enabled && !merge && sample == 1 && cap == LLONG_MAX;
+        this->pending = false;
+        this->start = 0;
+        this->id = 0;
+        this->duration = 0;
+        this->finished = false;
+        this->seen = 0;
+        this->written = 0;
+    }
 
-    while(completed<n){
-        // keep adding to the ready_queue all processes that have arrived.
-        while(idx<n && processes[idx]->arrival <= currentTime){
-            ready_queue.push(processes[idx]);
-            idx++;
+    void segment(long long start, long long id, long long duration, bool finished){
+        if (plain){
+            writeSegment(*out, trace, start, id, duration, finished);
+            return;
         }
-
-        // once you have emptied the ready queue, jump to the next process
-        if (ready_queue.empty()){
-            currentTime = processes[idx]->arrival;
-            continue;
+        if (!enabled) return;
+        if (!merge){
+            emit(start, id, duration, finished);
+            return;
         }
-        // from the ready queue, get the shortest job
-        Process* p = ready_queue.top();
-        ready_queue.pop();
-
-        cout << currentTime << " " << p->id << " " << p-> burst <<'X'<< endl;
-
-        p->start_time = currentTime;
-        p->completion_time = currentTime + p->burst;
-        currentTime += p->burst;
-        completed ++;
-        
+        if (pending && id == this->id && !this->finished && this->start + this->duration == start){
+            this->duration += duration;
+            this->finished = finished;
+            return;
+        }
+        if (pending){
+            emit(this->start, this->id, this->duration, this->finished);
+        }
+        pending = true;
+        this->start = start;
+        this->id = id;
+        this->duration = duration;
+        this->finished = finished;
     }
 
-    // sort it back by id order
-    sort(processes, processes + n, [](Process* a, Process* b){
-    return a->id < b->id;
-    });
-    printResults(testNumber,tc);
-    
-}
+    void emit(long long start, long long id, long long duration, bool finished){
+        seen++;
+        if ((seen - 1) % sample != 0 || written >= cap) return;
+        written++;
+        writeSegment(*out, trace, start, id, duration, finished);
+    }
 
-struct _PrioComp{
-    bool operator()(Process* a, Process*b){
-        if (a->nice != b->nice)
-            return a->nice > b->nice;
-        if (a->arrival != b->arrival)
-            return a->arrival > b->arrival;
-        return a->id > b->id;
+    // Ends the chart: writes the held back segment and says how many the cap left out.
+    void finish(){
+        if (pending){
+            emit(start, id, duration, finished);
+            pending = false;
+        }
+        long long dropped = (seen + sample - 1) / sample - written;
+        if (enabled && dropped > 0 && trace == nullptr){
+            *out << "... " << dropped << " more segments" << '\n';
+        }
+        seen = 0;
+        written = 0;
     }
 };
 
-void runPrio(int testNumber, TestCase* tc){
-    cout << testNumber << " " << tc->algorithm << endl;
-    int n = tc->size;
-    Process** processes = tc->processes;
-    int completed=0;
-    int currentTime= 0;
-    int idx = 0;
+/*
+Input reader for the num_test / n ALG [Q] / arrival burst nice grammar. A regular file is memory-mapped
+and scanned in place; anything else (a pipe or a terminal on stdin) is read in large chunks.
+Malformed input is reported with its line number and the program exits.
+*/
+struct InputReader {
+    static const size_t CHUNK = 1 << 20;
+    // Longest token the chunked path guarantees to have in memory before scanning it.
+    static const size_t MAX_TOKEN = 64;
+    int fd;
+    char* mapped;
+    size_t mappedSize;
+    char* chunk;
+    const char* cur;
+    const char* end;
+    bool eof;
+    int line;
+    // Test case and process being read, only used to describe errors (0 when not applicable).
+    int contextTest;
+    long long contextProcess;
 
-    // sort processes by arrival time, ascending
-    sort(processes, processes +n, [](Process* a, Process*b){
-        if (a->arrival != b->arrival){
-            return a->arrival < b-> arrival;
-        } else{
-            return a->id < b->id;
+    InputReader(int fd){
+        this->fd = fd;
+        this->mapped = nullptr;
+        this->mappedSize = 0;
+        this->chunk = nullptr;
+        this->eof = false;
+        this->line = 1;
+        this->contextTest = 0;
+        this->contextProcess = 0;
+        struct stat st;
+        if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0){
+            void* m = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (m != MAP_FAILED){
+                madvise(m, st.st_size, MADV_SEQUENTIAL);
+                mapped = (char*)m;
+                mappedSize = st.st_size;
+                cur = mapped;
+                end = mapped + mappedSize;
+                eof = true;
+                return;
+            }
         }
-    });
+        chunk = new char[CHUNK];
+        cur = end = chunk;
+    }
 
-    // creates a priority queue to store the processes by priority to simplify code
-    priority_queue<Process*, vector<Process*>, _PrioComp> ready_queue;
+    ~InputReader(){
+        if (mapped != nullptr){
+            munmap(mapped, mappedSize);
+        }
+        delete[] chunk;
+    }
 
-    Process* prev = nullptr;
-    int blockStart = 0;
+    // Moves the unread tail to the front of the chunk and reads more behind it.
+    void refill(){
+        if (eof) return;
+        size_t tail = end - cur;
+        memmove(chunk, cur, tail);
+        size_t filled = tail;
+        while (filled < CHUNK && !eof){
+            ssize_t r = ::read(fd, chunk + filled, CHUNK - filled);
+            if (r < 0){
+                if (errno == EINTR) continue;
+                perror("read");
+                exit(1);
+            }
+            if (r == 0){
+                eof = true;
+            }
+            filled += r;
+            // Stop once a reasonable amount is buffered, a pipe rarely fills the whole chunk at once.
+            if (filled - tail >= MAX_TOKEN) break;
+        }
+        cur = chunk;
+        end = chunk + filled;
+    }
 
-    while (completed < n){
-        // keep adding to the ready_queue all processes that have arrived.
-        while(idx<n && processes[idx]->arrival <= currentTime){
-            ready_queue.push(processes[idx]);
-            idx++;
+    [[noreturn]] void fail(const string& message){
+        cerr << "input:" << line << ": " << message << endl;
+        exit(1);
+    }
+
+    string describe(const char* what){
+        string result = what;
+        if (contextProcess > 0){
+            result += " of process " + to_string(contextProcess);
+        }
+        if (contextTest > 0){
+            result += (contextProcess > 0 ? " in test case " : " for test case ") + to_string(contextTest);
         }
+        return result;
+    }
 
-        // once you have emptied the ready queue, jump to the next process
-        if (ready_queue.empty()){
-            prev = nullptr;
-            blockStart = processes[idx]->arrival;
-            currentTime = processes[idx]->arrival;
-            continue;  
-        
+    // Skips whitespace, counting newlines, and leaves the next token fully in memory.
+    // Returns false at the end of the input.
+    bool nextToken(){
+        while (true){
+            while (cur < end && (*cur == ' ' || *cur == '\t' || *cur == '\r' || *cur == '\n')){
+                line += (*cur == '\n');
+                cur++;
+            }
+            if (cur < end || eof) break;
+            refill();
+        }
+        if (!eof && (size_t)(end - cur) < MAX_TOKEN){
+            refill();
         }
-        // from the ready queue, get the highest prio
-        Process* p = ready_queue.top();
-        ready_queue.pop();
+        return cur < end;
+    }
 
-        // calculate start and response time (for newly processed processes)
-        if(p->start_time == -1){
-            p->start_time = currentTime;
+    long long readInt(const char* what, long long lo, long long hi){
+        if (!nextToken()){
+            fail("unexpected end of input, expected " + describe(what));
+        }
+        const char* start = cur;
+        bool negative = (*cur == '-');
+        cur += negative;
+        unsigned long long value = 0;
+        int digits = 0;
+        // Unsigned compare folds the '0' <= c <= '9' check into one branch.
+        while (cur < end && (unsigned)(*cur - '0') < 10){
+            value = value * 10 + (*cur - '0');
+            cur++;
+            digits++;
         }
+        if (digits == 0 || (cur < end && !isspace((unsigned char)*cur))){
+            while (cur < end && !isspace((unsigned char)*cur)) cur++;
+            fail("expected " + describe(what) + ", got '" + string(start, cur) + "'");
+        }
+        if (digits > 18){
+            fail(describe(what) + " out of range: '" + string(start, cur) + "'");
+        }
+        long long result = negative ? -(long long)value : (long long)value;
+        if (result < lo || result > hi){
+            fail(describe(what) + " out of range [" + to_string(lo) + ", " + to_string(hi) + "]: " + to_string(result));
+        }
+        return result;
+    }
 
-        // if context switch is detected, print the current block and reset it
-        if(prev != nullptr && prev != p){
-            cout << blockStart << " "<< prev -> id <<" "<<  currentTime - blockStart << endl;
-            blockStart = currentTime;
+    // Reads "first..last" into first and last, or a single value into both. Returns whether it was a range.
+    bool readRange(const char* what, long long lo, long long hi, long long& first, long long& last){
+        if (!nextToken()){
+            fail("unexpected end of input, expected " + describe(what));
         }
+        const char* tokenEnd = cur;
+        while (tokenEnd < end && !isspace((unsigned char)*tokenEnd)) tokenEnd++;
+        string token(cur, tokenEnd);
+        size_t dots = token.find("..");
+        if (dots == string::npos){
+            first = last = readInt(what, lo, hi);
+            return false;
+        }
+        cur = tokenEnd;
+        char* stop;
+        errno = 0;
+        first = strtoll(token.c_str(), &stop, 10);
+        bool valid = stop == token.c_str() + dots && dots > 0;
+        last = strtoll(token.c_str() + dots + 2, &stop, 10);
+        valid = valid && *stop == '\0' && stop != token.c_str() + dots + 2 && errno == 0;
+        if (!valid){
+            fail("expected " + describe(what) + " as first..last, got '" + token + "'");
+        }
+        if (first < lo || last > hi || first > last){
+            fail("bad " + describe(what) + " range '" + token + "', expected first..last within ["
+                 + to_string(lo) + ", " + to_string(hi) + "]");
+        }
+        return true;
+    }
 
-        // run for 1 tick
-        p->remaining --;
-        currentTime ++;
+    // Consumes the next token if it is word.
+    bool skipWord(const char* word){
+        if (!nextToken()) return false;
+        size_t len = strlen(word);
+        if ((size_t)(end - cur) < len || memcmp(cur, word, len) != 0) return false;
+        if (cur + len < end && !isspace((unsigned char)cur[len])) return false;
+        cur += len;
+        return true;
+    }
 
-        // if the process is done, print and reset. else, push it back so that it could be
-        // reconsidered by the priority queue.
-        if (p->remaining == 0){
-            cout << blockStart <<" "<<  p -> id <<" "<<  currentTime - blockStart << 'X' << endl;
-            p->completion_time = currentTime;
-            completed++;
-            prev = nullptr;
-            blockStart = currentTime;
-        } else {
-            ready_queue.push(p);
-            prev = p;
+    string readWord(const char* what){
+        if (!nextToken()){
+            fail("unexpected end of input, expected " + describe(what));
         }
+        const char* start = cur;
+        while (cur < end && !isspace((unsigned char)*cur)) cur++;
+        return string(start, cur);
     }
-    // sort it back by id order
-    sort(processes, processes + n, [](Process* a, Process* b){
-    return a->id < b->id;
-    });
-    printResults(testNumber,tc);
-}
-
-void runRoundRobin(int testNumber, TestCase* tc) {
-    cout << testNumber << " " << tc->algorithm << endl;
+};
 
-    int n = tc->size;
-    Process** processes = tc->processes;
-    int quantum = tc->quantum;
+#if SCHED_TIME_BITS == 64
+typedef double MetricSum;      // a long long sum of 64-bit times can overflow
+#else
+typedef long long MetricSum;   // exact, and the same as the double running sum it replaced
+#endif
 
-    sort(processes, processes + n, [](Process* a, Process* b){
-        if (a->arrival != b->arrival) return a->arrival < b->arrival;
-        return a->id < b->id;
-    });
+/*
+Log-linear latency histogram in the style of HdrHistogram, used by --summary to get percentiles in
+one pass and fixed memory (about 58KB) however many processes there are. Values below 2^SUB_BITS
+get a bucket each; every power of two above that is split into 2^(SUB_BITS-1) buckets, so a
+reported percentile is the top of its bucket and at most 1/128 above the exact value. The maximum
+is kept exactly and the sum as a MetricSum, like the averages of the normal output.
+*/
+struct LatencyHistogram {
+    static const int SUB_BITS = 8;
+    static const int HALF = 1 << (SUB_BITS - 1);
+    vector<long long> counts;
+    long long total;
+    MetricSum sum;
+    long long maxValue;
 
-    queue<Process*> fresh;   // Hold all new processes
-    queue<Process*> used;    // Hold all proceses that have been processed before
+    LatencyHistogram() : counts((64 - SUB_BITS + 2) * HALF, 0){
+        this->total = 0;
+        this->sum = 0;
+        this->maxValue = 0;
+    }
 
-    int idx = 0;
-    int currentTime = 0;
-    int completed = 0;
+    void clear(){
+        fill(counts.begin(), counts.end(), 0);
+        total = 0;
+        sum = 0;
+        maxValue = 0;
+    }
 
-    while (completed < n) {
+    static int bucket(long long value){
+        if (value < (1LL << SUB_BITS)) return (int)value;
+        int shift = 63 - __builtin_clzll(value) - SUB_BITS + 1;
+        return shift * HALF + (int)(value >> shift);
+    }
 
-        // Bring in arrivals
-        while (idx < n && processes[idx]->arrival <= currentTime) {
-            fresh.push(processes[idx]);
-            idx++;
-        }
+    // Largest value that falls in bucket b.
+    static long long highest(int b){
+        if (b < (1 << SUB_BITS)) return b;
+        int shift = b / HALF - 1;
+        long long mantissa = b - shift * HALF;
+        return ((mantissa + 1) << shift) - 1;
+    }
 
-        // CPU idle, jump the current time to the next arrival
-        if (fresh.empty() && used.empty()) {
-            currentTime = processes[idx]->arrival;
-            continue;
-        }
+    void record(long long value){
+        total++;
+        sum += value;
+        // negative values only come from a clock that overflowed, they count as 0
+        value = max(0LL, value);
+        counts[bucket(value)]++;
+        maxValue = max(maxValue, value);
+    }
 
-        // Choose next process, fresh processes first
-        Process* p;
-        if (!fresh.empty()) {
-            p = fresh.front(); fresh.pop();
-        } else {
-            p = used.front(); used.pop();
+    // Smallest value that at least p percent of the recorded values are not above.
+    long long percentile(double p) const {
+        long long rank = max(1LL, (long long)ceil(p / 100 * total));
+        long long seen = 0;
+        for (size_t b = 0; b < counts.size(); b++){
+            seen += counts[b];
+            if (seen >= rank) return min(highest(b), maxValue);
         }
+        return maxValue;
+    }
 
-        // Set start time if first time running 
-        if (p->start_time == -1)
-            p->start_time = currentTime;
+    // Prints the average line of the normal output, followed by the percentiles.
+    void print(Output& out, const char* what) const {
+        out << "Average " << what << " time: " << (double)sum / total << "ns" << '\n';
+        out << "p50/p95/p99/max " << what << " time: " << percentile(50) << "/" << percentile(95) << "/"
+            << percentile(99) << "/" << maxValue << "ns" << '\n';
+    }
+};
 
-        // Calculate how long this process will run
-        int runTime = min(quantum, p->remaining);
-        p->remaining -= runTime;
+// What computeMetrics returns besides the three metric arrays.
+struct MetricTotals {
+    long long totalBurst = 0;
+    Time totalTime = 0;        // latest completion
+    MetricSum waiting = 0;
+    MetricSum turnaround = 0;
+    MetricSum response = 0;
+};
 
-        cout << currentTime << " " << p->id << " " << runTime;
+// Scalar metric pass over processes [from, n), also the tail of the AVX2 pass.
+void computeMetricsScalar(ProcessTable& t, int from, int n, MetricTotals& m){
+    for (int i = from; i < n; i++){
+        Time turnaround = t.completion_time[i] - t.arrival[i];
+        Time waiting = turnaround - t.burst[i];
+        Time response = t.start_time[i] - t.arrival[i];
+        t.turnaround_time[i] = turnaround;
+        t.waiting_time[i] = waiting;
+        t.response_time[i] = response;
+        m.totalBurst += t.burst[i];
+        m.totalTime = max(m.totalTime, t.completion_time[i]);
+        m.waiting += waiting;
+        m.turnaround += turnaround;
+        m.response += response;
+    }
+}
 
-        currentTime += runTime;
+#if SCHED_TIME_BITS == 32 && defined(__x86_64__)
+// Adds the eight 32-bit lanes of v to the four 64-bit lanes of sum.
+__attribute__((target("avx2")))
+inline __m256i addWidened(__m256i sum, __m256i v){
+    __m256i low = _mm256_cvtepi32_epi64(_mm256_castsi256_si128(v));
+    __m256i high = _mm256_cvtepi32_epi64(_mm256_extracti128_si256(v, 1));
+    return _mm256_add_epi64(sum, _mm256_add_epi64(low, high));
+}
 
-        // Determine if process is complete
-        bool finished = (p->remaining == 0);
-        if (finished) {
-            cout << "X";
-            p->completion_time = currentTime;
-            completed++;
-        }
-        cout << endl;
+__attribute__((target("avx2")))
+long long sumLanes(__m256i v){
+    long long lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, v);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
 
-        // Check for processes that arrived during this execution because these will be added in the next iteration 
-        // To ensure priority over the currently preempted process 
-        
+// AVX2 metric pass, eight processes at a time. Returns how many processes it covered.
+__attribute__((target("avx2")))
+int computeMetricsAVX2(ProcessTable& t, int n, MetricTotals& m){
+    __m256i burstSum = _mm256_setzero_si256();
+    __m256i waitSum = _mm256_setzero_si256();
+    __m256i turnSum = _mm256_setzero_si256();
+    __m256i respSum = _mm256_setzero_si256();
+    __m256i latest = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 8 <= n; i += 8){
+        __m256i arrival = _mm256_loadu_si256((const __m256i*)(t.arrival + i));
+        __m256i burst = _mm256_loadu_si256((const __m256i*)(t.burst + i));
+        __m256i start = _mm256_loadu_si256((const __m256i*)(t.start_time + i));
+        __m256i completion = _mm256_loadu_si256((const __m256i*)(t.completion_time + i));
+        __m256i turnaround = _mm256_sub_epi32(completion, arrival);
+        __m256i waiting = _mm256_sub_epi32(turnaround, burst);
+        __m256i response = _mm256_sub_epi32(start, arrival);
+        _mm256_storeu_si256((__m256i*)(t.turnaround_time + i), turnaround);
+        _mm256_storeu_si256((__m256i*)(t.waiting_time + i), waiting);
+        _mm256_storeu_si256((__m256i*)(t.response_time + i), response);
+        burstSum = addWidened(burstSum, burst);
+        waitSum = addWidened(waitSum, waiting);
+        turnSum = addWidened(turnSum, turnaround);
+        respSum = addWidened(respSum, response);
+        latest = _mm256_max_epi32(latest, completion);
+    }
+    m.totalBurst += sumLanes(burstSum);
+    m.waiting += sumLanes(waitSum);
+    m.turnaround += sumLanes(turnSum);
+    m.response += sumLanes(respSum);
+    int lanes[8];
+    _mm256_storeu_si256((__m256i*)lanes, latest);
+    for (int k = 0; k < 8; k++){
+        m.totalTime = max(m.totalTime, lanes[k]);
+    }
+    return i;
+}
+#endif
 
-        // If process is not finished we add it to the BACK to the queue
-        // Because preempted processes goes to the back
-        if (!finished) {
-        //put new arrival into the fresh queue
-            while (idx < n && processes[idx]->arrival <= currentTime) {
-            fresh.push(processes[idx]);
-            idx++;
-        }
-        // After adding new arrivals, we add the preempted process to the back of the used queue
-        used.push(p);
-        }
+/*
+Metric step of printResults in one pass over the contiguous completion, arrival, burst and start
+arrays: fills the turnaround, waiting and response arrays and returns their sums, the total burst
+and the latest completion. With 32-bit Time it runs eight processes at a time with AVX2 when the
+CPU has it (checked at run time, so the binary needs no -mavx2), and the scalar loop does the rest.
+*/
+MetricTotals computeMetrics(ProcessTable& t, int n){
+    MetricTotals m;
+    int from = 0;
+#if SCHED_TIME_BITS == 32 && defined(__x86_64__)
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    if (avx2){
+        from = computeMetricsAVX2(t, n, m);
     }
+#endif
+    computeMetricsScalar(t, from, n, m);
+    return m;
+}
+
+void writeResults(int testNumber, TestCase* tc, Output& out) {
+    int n = tc->size;
+    int cpus = tc->options.cpus;
+    ProcessTable& t = tc->procs;
 
-    sort(processes, processes + n, [](Process* a, Process* b){
-        return a->id < b->id;
-    });
+    // Compute metrics for each process
+    MetricTotals metrics = computeMetrics(t, n);
+    long long totalBurst = metrics.totalBurst;
+    Time totalTime = metrics.totalTime;
 
-    printResults(testNumber, tc);
-}
+    // with several CPUs the available time is cpus * totalTime
+    int cpuUtil = (int)((double)totalBurst / ((double)totalTime * cpus) * 100);
+    double throughput = (double)n / totalTime;
 
-int main(void){
-    int num_test;
-    cin >> num_test;
-    
-    // Iterates through each test case
-    for (int i = 0; i < num_test; i++){
-        int num_process;
-        string algorithm;
-        
-        cin >> num_process >> algorithm;
-        TestCase* testCase = new TestCase(num_process, algorithm);
-
-        //Read time quantum if Round Robin
-        if (algorithm == "RR"){
-            cin >> testCase->quantum;
-        }
-        
-        // Iterates through each process per test case
-        for (int j = 0; j < num_process; j++){
-            int arrival, burst, nice;
-            cin >> arrival >> burst >> nice;
-            Process* proc = new Process(j+1, arrival, burst, nice);
-            testCase->addProcess(j, proc);
-        }
-        if (algorithm == "FCFS"){
-            runFCFS(i+1, testCase);
-        }
-        else if (algorithm == "SRTF"){
-            runSRTF(i+1, testCase);
-        } else if (algorithm == "SJF"){
-            runSJF(i+1,testCase);
-        } else if (algorithm == "P"){
-            runPrio(i+1,testCase);
-        } 
-        else if (algorithm == "RR"){
-            runRoundRobin(i+1, testCase);
-        }
-        delete testCase;
+    out << "Total time elapsed: " << totalTime << "ns" << '\n';
+    out << "Total CPU burst time: " << totalBurst << "ns" << '\n';
+    out << "CPU Utilization: " << cpuUtil << "%" << '\n';
+    out << "Throughput: " << throughput << " processes/ns" << '\n';
+
+    if (tc->options.summary){
+        LatencyHistogram waiting, turnaround, response;
+        for (int i = 0; i < n; i++){
+            waiting.record(t.waiting_time[i]);
+            turnaround.record(t.turnaround_time[i]);
+            response.record(t.response_time[i]);
+        }
+        waiting.print(out, "waiting");
+        turnaround.print(out, "turnaround");
+        response.print(out, "response");
+        return;
+    }
+
+    // Waiting times
+    out << "Waiting times:" << '\n';
+    for (int i = 0; i < n; i++){
+        out << " Process " << t.id(i) << ": " << t.waiting_time[i] << "ns" << '\n';
+    }
+    out << "Average waiting time: " << (double)metrics.waiting / n << "ns" << '\n';
+
+    // Turnaround times
+    out << "Turnaround times:" << '\n';
+    for (int i = 0; i < n; i++){
+        out << " Process " << t.id(i) << ": " << t.turnaround_time[i] << "ns" << '\n';
+    }
+    out << "Average turnaround time: " << (double)metrics.turnaround / n << "ns" << '\n';
+
+    // Response times
+    out << "Response times:" << '\n';
+    for (int i = 0; i < n; i++){
+        out << " Process " << t.id(i) << ": " << t.response_time[i] << "ns" << '\n';
+    }
+    out << "Average response time: " << (double)metrics.response / n << "ns" << '\n';
+}
+
+void printResults(int testNumber, TestCase* tc, Output& out){
+    STAT_TIME(tc->stats, printNs, writeResults(testNumber, tc, out));
+}
+
+/*
+Stable LSD radix sort of packed (arrival, index) keys, 8 bits per pass. The index is in the low
+32 bits and the keys start out in index order, so only the arrival half is sorted: being stable,
+processes that arrive together keep their id order. Each pass streams through the keys instead
+of looking up arrival[order[i]]. Passes where every key has the same byte are skipped, so small
+arrival ranges only cost one or two passes. scratch must hold n keys.
+*/
+void radixSortByArrival(unsigned long long* keys, int n, unsigned long long* scratch){
+    unsigned long long* src = keys;
+    unsigned long long* dst = scratch;
+    for (int shift = 32; shift < 64; shift += 8){
+        int count[257] = {0};
+        for (int i = 0; i < n; i++){
+            count[((src[i] >> shift) & 0xFF) + 1]++;
+        }
+        bool trivial = false;
+        for (int b = 1; b <= 256; b++){
+            if (count[b] == n) trivial = true;
+        }
+        if (trivial) continue;
+        for (int b = 0; b < 256; b++){
+            count[b + 1] += count[b];
+        }
+        for (int i = 0; i < n; i++){
+            dst[count[(src[i] >> shift) & 0xFF]++] = src[i];
+        }
+        swap(src, dst);
+    }
+    if (src != keys){
+        copy(src, src + n, keys);
+    }
+}
+
+// Below this many processes a comparison sort is faster than the radix passes.
+const int RADIX_SORT_THRESHOLD = 256;
+
+/*
+Arrival order of a test case: the process indices sorted by (arrival, id), in an arena array.
+It is computed on the first call and kept in the TestCase, so every policy, what-if re-run and
+sweep copy (see TestCase::resetFrom) shares it. The process table itself is never reordered,
+so printResults can walk it in id order afterwards.
+*/
+int* sortedByArrival(TestCase* tc){
+    if (tc->arrivalOrder != nullptr){
+        return tc->arrivalOrder;
+    }
+    int n = tc->size;
+    const Time* arrival = tc->procs.arrival;
+    if (SCHED_TIME_BITS == 64){
+        int* order = tc->arena.allocate<int>(n);
+        for (int i = 0; i < n; i++){
+            order[i] = i;
+        }
+        stable_sort(order, order + n, [arrival](int a, int b){ return arrival[a] < arrival[b]; });
+        tc->arrivalOrder = order;
+        return order;
+    }
+    // Flipping the sign bit makes negative arrivals order before positive ones.
+    unsigned long long* keys = tc->arena.allocate<unsigned long long>(n);
+    for (int i = 0; i < n; i++){
+        keys[i] = (unsigned long long)((unsigned)(int)arrival[i] ^ 0x80000000u) << 32 | (unsigned)i;
+    }
+    if (n >= RADIX_SORT_THRESHOLD){
+        radixSortByArrival(keys, n, tc->arena.allocate<unsigned long long>(n));
+    } else {
+        sort(keys, keys + n);
+    }
+    int* order = tc->arena.allocate<int>(n);
+    for (int i = 0; i < n; i++){
+        order[i] = (int)(unsigned)keys[i];
+    }
+    tc->arrivalOrder = order;
+    return order;
+}
+
+/*
+Ready queue orderings, in priority_queue form: operator()(a, b) is true if a runs after b.
+*/
+struct _SRTFcomp{
+    const ProcessTable* t;
+    bool operator()(int a, int b) const {
+        if (t->remaining[a] != t->remaining[b])
+            return t->remaining[a] > t->remaining[b];
+        if (t->arrival[a] != t->arrival[b])
+            return t->arrival[a] > t->arrival[b];
+        return a > b;
+    }
+};
+
+struct _SJFcomp{
+    const ProcessTable* t;
+    bool operator()(int a, int b) const {
+         if (t->burst[a] != t->burst[b])
+            return t->burst[a] > t->burst[b];
+        if (t->arrival[a] != t->arrival[b])
+            return t->arrival[a] > t->arrival[b];
+        return a > b;
+    }
+};
+
+struct _PrioComp{
+    const ProcessTable* t;
+    bool operator()(int a, int b) const {
+        if (t->nice[a] != t->nice[b])
+            return t->nice[a] > t->nice[b];
+        if (t->arrival[a] != t->arrival[b])
+            return t->arrival[a] > t->arrival[b];
+        return a > b;
+    }
+};
+
+/*
+Ready queue kinds used by the policies. Every kind has the same interface: push(p, isNew), where
+isNew is true the first time a process is queued, pop(), empty() and size(). renumber(to) replaces
+every queued p by to[p] and must be given a mapping that keeps their order (see StreamTable).
+*/
+
+// Binary heap ordered by Comp.
+template <typename Comp>
+struct HeapQueue {
+    Comp comp;
+    vector<int> heap;
+
+    HeapQueue(const ProcessTable* t) : comp{t} {}
+
+    void push(int p, bool){
+        heap.push_back(p);
+        push_heap(heap.begin(), heap.end(), comp);
+    }
+
+    int pop(){
+        pop_heap(heap.begin(), heap.end(), comp);
+        int p = heap.back();
+        heap.pop_back();
+        return p;
+    }
+
+    int top() const { return heap.front(); }
+    bool empty() const { return heap.empty(); }
+    size_t size() const { return heap.size(); }
+
+    // The queue as a flat list, and back (used by snapshots).
+    vector<int> contents() const { return heap; }
+    void restore(const vector<int>& items){ heap = items; }
+
+    void renumber(const int* to){
+        for (int& p : heap) p = to[p];
+    }
+};
+
+// Plain FIFO. Processes are admitted in (arrival, id) order, so for FCFS this is the arrival order.
+struct FifoQueue {
+    deque<int> items;
+
+    FifoQueue(const ProcessTable*) {}
+
+    void push(int p, bool){
+        items.push_back(p);
+    }
+
+    int pop(){
+        int p = items.front();
+        items.pop_front();
+        return p;
+    }
+
+    bool empty() const { return items.empty(); }
+    size_t size() const { return items.size(); }
+
+    vector<int> contents() const { return vector<int>(items.begin(), items.end()); }
+    void restore(const vector<int>& list){ items.assign(list.begin(), list.end()); }
+
+    void renumber(const int* to){
+        for (int& p : items) p = to[p];
+    }
+};
+
+// Round robin: processes that have not run yet go ahead of the ones that were preempted.
+struct RoundRobinQueue {
+    deque<int> fresh;   // Hold all new processes
+    deque<int> used;    // Hold all proceses that have been processed before
+
+    RoundRobinQueue(const ProcessTable*) {}
+
+    void push(int p, bool isNew){
+        (isNew ? fresh : used).push_back(p);
+    }
+
+    int pop(){
+        deque<int>& from = fresh.empty() ? used : fresh;
+        int p = from.front();
+        from.pop_front();
+        return p;
+    }
+
+    bool empty() const { return fresh.empty() && used.empty(); }
+    size_t size() const { return fresh.size() + used.size(); }
+
+    // number of fresh processes, the fresh ones, then the used ones
+    vector<int> contents() const {
+        vector<int> list(1, (int)fresh.size());
+        list.insert(list.end(), fresh.begin(), fresh.end());
+        list.insert(list.end(), used.begin(), used.end());
+        return list;
+    }
+
+    void restore(const vector<int>& list){
+        fresh.assign(list.begin() + 1, list.begin() + 1 + list[0]);
+        used.assign(list.begin() + 1 + list[0], list.end());
+    }
+
+    void renumber(const int* to){
+        for (int& p : fresh) p = to[p];
+        for (int& p : used) p = to[p];
+    }
+};
+
+/*
+Bucket queue for P: one FIFO per nice level from MIN_NICE to MIN_NICE + LEVELS - 1, each in
+(arrival, id) order, and a bitmap of the non-empty ones, so the best level is a count-trailing-zeros
+away and push and pop are O(1) instead of O(log n). New processes are admitted in (arrival, id)
+order, so they go to the back of their bucket. A process coming back after a preemption was the
+head of its bucket when it was picked and everything queued since arrived later, so it goes back
+to the front; only when that does not hold (a process stolen from another core under --cpus, or a
+snapshot being restored) is it inserted in order with a binary search.
+A bucket is a vector with a moving head, so the common pop-then-push-front costs no shifting.
+Nice levels outside the bucket range fall back to a heap ordered by _PrioComp.
+*/
+struct PrioBucketQueue {
+    static const int MIN_NICE = -32;
+    static const int LEVELS = 64;
+
+    struct Bucket {
+        vector<int> items;
+        size_t head = 0;   // items before head were popped
+    };
+
+    const ProcessTable* t;
+    Bucket buckets[LEVELS];
+    unsigned long long nonEmpty;
+    size_t count;
+    HeapQueue<_PrioComp> outside;
+
+    PrioBucketQueue(const ProcessTable* t) : outside(t){
+        this->t = t;
+        this->nonEmpty = 0;
+        this->count = 0;
+    }
+
+    // Whether a comes before b in a bucket.
+    bool precedes(int a, int b) const {
+        return t->arrival[a] != t->arrival[b] ? t->arrival[a] < t->arrival[b] : a < b;
+    }
+
+    void push(int p, bool isNew){
+        count++;
+        unsigned level = (unsigned)(t->nice[p] - MIN_NICE);
+        if (level >= (unsigned)LEVELS){
+            outside.push(p, isNew);
+            return;
+        }
+        Bucket& b = buckets[level];
+        nonEmpty |= 1ULL << level;
+        if (isNew){
+            b.items.push_back(p);
+        }
+        else if (b.head == b.items.size() || precedes(p, b.items[b.head])){
+            if (b.head > 0){
+                b.items[--b.head] = p;
+            } else {
+                b.items.insert(b.items.begin(), p);
+            }
+        }
+        else {
+            auto at = lower_bound(b.items.begin() + b.head, b.items.end(), p,
+                                  [this](int a, int c){ return precedes(a, c); });
+            b.items.insert(at, p);
+        }
+    }
+
+    int pop(){
+        count--;
+        if (!outside.empty() && (nonEmpty == 0 || t->nice[outside.top()] < MIN_NICE)){
+            return outside.pop();
+        }
+        int level = __builtin_ctzll(nonEmpty);
+        Bucket& b = buckets[level];
+        int p = b.items[b.head++];
+        if (b.head == b.items.size()){
+            b.items.clear();
+            b.head = 0;
+            nonEmpty &= ~(1ULL << level);
+        }
+        else if (b.head >= 4096 && 2 * b.head >= b.items.size()){
+            b.items.erase(b.items.begin(), b.items.begin() + b.head);
+            b.head = 0;
+        }
+        return p;
+    }
+
+    bool empty() const { return count == 0; }
+    size_t size() const { return count; }
+
+    vector<int> contents() const {
+        vector<int> list = outside.contents();
+        for (int level = 0; level < LEVELS; level++){
+            const Bucket& b = buckets[level];
+            list.insert(list.end(), b.items.begin() + b.head, b.items.end());
+        }
+        return list;
+    }
+
+    // Takes any order, so snapshots of the heap this queue replaced still restore.
+    void restore(const vector<int>& list){
+        for (int level = 0; level < LEVELS; level++){
+            buckets[level].items.clear();
+            buckets[level].head = 0;
+        }
+        nonEmpty = 0;
+        count = 0;
+        outside.restore({});
+        for (int p : list){
+            push(p, false);
+        }
+    }
+
+    void renumber(const int* to){
+        for (int level = 0; level < LEVELS; level++){
+            Bucket& b = buckets[level];
+            for (size_t i = b.head; i < b.items.size(); i++){
+                b.items[i] = to[b.items[i]];
+            }
+        }
+        outside.renumber(to);
+    }
+};
+
+/*
+Policy traits for runEngine, runSMP and simulateStream:
+  Queue       ready queue kind
+  preemptive  an arrival that would be picked before the running process preempts it;
+              outranks(t, a, b) says whether a would be picked before b
+  timeSliced  a process runs for at most the test case's quantum at a time
+Adding a policy only takes a new traits struct (and usually a comparator) plus a line in runTestCase.
+CFS and MLFQ have their own loops (runCFS, runMLFQ) because they do not fit this model: the length
+of a CFS slice depends on the weights of everything queued and every run updates the process's
+vruntime, and an MLFQ process carries its level and used quantum, goes back to the front or the
+back of a level depending on why it stopped, and the boosts are events of their own. Traits for
+them would need hooks around every step of the loop, which would cost the other policies their
+simple inlined path.
+*/
+struct FCFSPolicy {
+    typedef FifoQueue Queue;
+    static const bool preemptive = false;
+    static const bool timeSliced = false;
+    static bool outranks(const ProcessTable*, int, int){ return false; }
+};
+
+struct SJFPolicy {
+    typedef HeapQueue<_SJFcomp> Queue;
+    static const bool preemptive = false;
+    static const bool timeSliced = false;
+    static bool outranks(const ProcessTable*, int, int){ return false; }
+};
+
+struct SRTFPolicy {
+    typedef HeapQueue<_SRTFcomp> Queue;
+    static const bool preemptive = true;
+    static const bool timeSliced = false;
+    static bool outranks(const ProcessTable* t, int a, int b){ return _SRTFcomp{t}(b, a); }
+};
+
+struct PrioPolicy {
+    typedef PrioBucketQueue Queue;
+    static const bool preemptive = true;
+    static const bool timeSliced = false;
+    static bool outranks(const ProcessTable* t, int a, int b){ return _PrioComp{t}(b, a); }
+};
+
+struct RoundRobinPolicy {
+    typedef RoundRobinQueue Queue;
+    static const bool preemptive = false;
+    static const bool timeSliced = true;
+    static bool outranks(const ProcessTable*, int, int){ return false; }
+};
+
+/*
+State of runEngine between two decisions, everything needed to stop the simulation and pick it
+up again later (see EngineCheckpoints). The process table holds the rest.
+*/
+template <typename Policy>
+struct EngineState {
+    Time currentTime;
+    int idx;          // cursor over the arrival order, the processes before it have been queued
+    int completed;
+    typename Policy::Queue ready_queue;
+
+    EngineState(const ProcessTable* t) : ready_queue(t){
+        this->currentTime = 0;
+        this->idx = 0;
+        this->completed = 0;
+    }
+};
+
+/*
+Snapshots of a running simulation (--snapshot FILE), so that a long run can be stopped and later
+continued with --resume FILE, with the same output as an uninterrupted run. A snapshot is taken
+every `every` decisions if set, on SIGUSR1, and on SIGTERM, after which the program stops.
+The FCFS/SJF/SRTF/P/RR engine takes them between two decisions; a signal that arrives while
+anything else runs is handled once that test case is done. A snapshot holds a SnapshotHeader
+(where the next test case starts in the input, how much output is final, the engine state) and
+then, if a test case was running, its arrival, burst, remaining, start and completion arrays
+(Time), its nice array and the ready queue. Everything is in native byte order.
+The file is written next to FILE, synced and renamed over it, so a crash never leaves half of one.
+Resuming seeks in the input and truncates the output, so both must be regular files.
+*/
+volatile sig_atomic_t snapshotSignal = 0;   // SIGUSR1 or SIGTERM once one arrived
+
+struct SnapshotHeader {
+    static constexpr const char* MAGIC = "SCHEDSN2";
+    char magic[8];
+    long long inputSize;
+    long long inputOffset;   // where the next test case starts
+    long long outputOffset;  // output that is final
+    long long decisions;
+    int inputLine;
+    int numTests;
+    int testNumber;          // test case being simulated, or the last finished one
+    int running;             // 1 if the engine state below and the arrays are there
+    int size;
+    int timeBits;            // SCHED_TIME_BITS of the build that wrote it
+    long long quantum;
+    long long currentTime;
+    int idx;
+    int completed;
+    int queueSize;
+    char algorithm[8];
+};
+
+struct Snapshotter {
+    string path;
+    long long every;   // decisions between snapshots, 0 for snapshots on signals only
+    long long next;
+    InputReader* in;
+    Output* out;
+    int numTests;
+    int testNumber;
+
+    Snapshotter(const string& path, long long every, InputReader* in, Output* out){
+        this->path = path;
+        this->every = every;
+        this->next = every;
+        this->in = in;
+        this->out = out;
+        this->numTests = 0;
+        this->testNumber = 0;
+    }
+
+    bool due(long long decisions) const {
+        return snapshotSignal != 0 || (every > 0 && decisions >= next);
+    }
+
+    SnapshotHeader header(){
+        out->flush();
+        SnapshotHeader h;
+        memset(&h, 0, sizeof h);
+        memcpy(h.magic, SnapshotHeader::MAGIC, 8);
+        h.inputSize = in->mappedSize;
+        h.inputOffset = in->cur - in->mapped;
+        h.inputLine = in->line;
+        h.outputOffset = lseek(out->fd, 0, SEEK_CUR);
+        h.numTests = numTests;
+        h.testNumber = testNumber;
+        return h;
+    }
+
+    // Writes the snapshot, then stops the program if it was asked to by SIGTERM.
+    void write(const SnapshotHeader& h, const vector<const Time*>& arrays, const int* nice, const vector<int>& queue){
+        string tmp = path + ".tmp";
+        int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0){
+            perror(tmp.c_str());
+            exit(1);
+        }
+        Output::writeAll(fd, (const char*)&h, sizeof h);
+        for (const Time* a : arrays){
+            Output::writeAll(fd, (const char*)a, (size_t)h.size * sizeof(Time));
+        }
+        if (nice != nullptr){
+            Output::writeAll(fd, (const char*)nice, (size_t)h.size * sizeof(int));
+        }
+        Output::writeAll(fd, (const char*)queue.data(), queue.size() * sizeof(int));
+        if (fsync(fd) < 0 || close(fd) < 0 || rename(tmp.c_str(), path.c_str()) < 0){
+            perror(path.c_str());
+            exit(1);
+        }
+        int received = snapshotSignal;
+        snapshotSignal = 0;
+        if (received == SIGTERM){
+            cerr << "stopped, continue with --resume " << path << endl;
+            exit(128 + SIGTERM);
+        }
+    }
+
+    // Snapshot between two decisions of the engine.
+    template <typename Policy>
+    void save(const TestCase* tc, const EngineState<Policy>& state){
+        SnapshotHeader h = header();
+        const ProcessTable& t = tc->procs;
+        vector<int> queue = state.ready_queue.contents();
+        h.decisions = tc->decisions;
+        h.running = 1;
+        h.size = tc->size;
+        h.quantum = tc->quantum;
+        h.timeBits = SCHED_TIME_BITS;
+        h.currentTime = state.currentTime;
+        h.idx = state.idx;
+        h.completed = state.completed;
+        h.queueSize = queue.size();
+        strncpy(h.algorithm, tc->algorithm.c_str(), sizeof h.algorithm - 1);
+        next = tc->decisions + every;
+        write(h, {t.arrival, t.burst, t.remaining, t.start_time, t.completion_time}, t.nice, queue);
+    }
+
+    // Snapshot after test case testNumber has been written out.
+    void saveBetween(){
+        write(header(), {}, nullptr, {});
+    }
+};
+
+template <typename Policy>
+struct EngineCheckpoints;
+
+/*
+Where simulate() takes its processes from, for a test case that is in memory: a cursor over the
+arrival order from sortedByArrival. An arrival source has
+  pending()     whether a process has yet to arrive
+  next()        when the next one arrives
+  peek()        its index in the process table, before it is queued
+  admit()       the same index, after which the source moves on to the process after it
+  finish(p, t)  records that process p finished at time t
+  id(p)         the id p goes by in the Gantt chart
+  settle(q)     called before each decision, while every live process is in ready queue q
+  save(state)   stores the cursor in an EngineState, for snapshots and checkpoints
+The other source is StreamArrivals, which reads the processes from the input as they are needed.
+*/
+struct SortedArrivals {
+    ProcessTable* t;
+    const int* order;
+    int n;
+    int idx;
+
+    SortedArrivals(TestCase* tc, const int* order, int idx){
+        this->t = &tc->procs;
+        this->order = order;
+        this->n = tc->size;
+        this->idx = idx;
+    }
+
+    bool pending() const { return idx < n; }
+    Time next() const { return t->arrival[order[idx]]; }
+    int peek() const { return order[idx]; }
+    int admit(){ return order[idx++]; }
+    void finish(int p, Time time){ t->completion_time[p] = time; }
+    long long id(int p) const { return t->id(p); }
+    template <typename Queue> void settle(Queue&){}
+    template <typename State> void save(State& state) const { state.idx = idx; }
+};
+
+/*
+Single-CPU scheduling loop shared by FCFS, SJF, SRTF, P and RR; everything that differs between
+them comes from Policy, so each instantiation gets its own loop with the comparisons inlined.
+Time only moves to arrivals and to the ends of run segments:
+  - a non-preemptive process runs to completion, a time-sliced one for at most the quantum,
+  - a preemptive one runs until it finishes or an arrival outranks it. Arrivals are visited in
+    order, so only the next one has to be checked: if it does not preempt it is queued and the
+    one after it is checked,
+  - arrivals during a segment are queued before the process that was stopped goes back, so under
+    RR they run first.
+Every segment goes to the GanttWriter, with X when the process finished.
+simulate() runs from state until every process has arrived and finished; the processes come from
+arrivals, a SortedArrivals or, in streaming mode, a StreamArrivals. With checkpoints, the state is
+saved every so often before a decision.
+*/
+template <typename Policy, typename Arrivals>
+void simulate(TestCase* tc, Arrivals& arrivals, EngineState<Policy>& state, GanttWriter& gantt,
+              EngineCheckpoints<Policy>* checkpoints){
+    ProcessTable& t = tc->procs;
+    int completed = state.completed;
+    Time currentTime = state.currentTime;
+    typename Policy::Queue& ready_queue = state.ready_queue;
+
+    while (arrivals.pending() || !ready_queue.empty()){
+        if (checkpoints != nullptr && tc->decisions >= checkpoints->next){
+            state.currentTime = currentTime;
+            arrivals.save(state);
+            state.completed = completed;
+            checkpoints->save(tc, state, gantt);
+        }
+        if (tc->snapshots != nullptr && tc->snapshots->due(tc->decisions)){
+            state.currentTime = currentTime;
+            arrivals.save(state);
+            state.completed = completed;
+            tc->snapshots->save(tc, state);
+        }
+        arrivals.settle(ready_queue);
+
+        // keep adding to the ready_queue all processes that have arrived.
+        while (arrivals.pending() && arrivals.next() <= currentTime){
+            ready_queue.push(arrivals.admit(), true);
+            STAT_ADD(tc->stats, pushes, 1);
+        }
+
+        // CPU idle, jump the current time to the next arrival
+        if (ready_queue.empty()){
+            STAT_ADD(tc->stats, idleJumps, 1);
+            STAT_ADD(tc->stats, idleTime, (long long)arrivals.next() - currentTime);
+            currentTime = arrivals.next();
+            continue;
+        }
+
+        int p = ready_queue.pop();
+        STAT_ADD(tc->stats, pops, 1);
+        STAT_SWITCH(tc->stats, arrivals.id(p));
+        tc->decisions++;
+        if (t.start_time[p] == -1){
+            t.start_time[p] = currentTime;
+        }
+
+        Time startRemaining = t.remaining[p];
+        Time runUntil = currentTime + startRemaining;
+        if (Policy::timeSliced){
+            runUntil = currentTime + min(tc->quantum, startRemaining);
+        }
+        if (Policy::preemptive){
+            while (arrivals.pending() && arrivals.next() < runUntil){
+                int incoming = arrivals.peek();
+                // compare against what p has left at the moment incoming arrives
+                t.remaining[p] = startRemaining - (t.arrival[incoming] - currentTime);
+                if (Policy::outranks(&t, incoming, p)){
+                    runUntil = t.arrival[incoming];
+                    break;
+                }
+                ready_queue.push(arrivals.admit(), true);
+                STAT_ADD(tc->stats, pushes, 1);
+            }
+        }
+
+        Time runDuration = runUntil - currentTime;
+        t.remaining[p] = startRemaining - runDuration;
+        gantt.segment(currentTime, arrivals.id(p), runDuration, t.remaining[p] == 0);
+        STAT_ADD(tc->stats, segments, 1);
+        currentTime = runUntil;
+
+        if (t.remaining[p] == 0){
+            arrivals.finish(p, currentTime);
+            completed++;
+        } else {
+            while (arrivals.pending() && arrivals.next() <= currentTime){
+                ready_queue.push(arrivals.admit(), true);
+                STAT_ADD(tc->stats, pushes, 1);
+            }
+            ready_queue.push(p, false);
+            STAT_ADD(tc->stats, pushes, 1);
+            STAT_ADD(tc->stats, preemptions, 1);
+        }
+    }
+}
+
+template <typename Policy>
+void runEngine(int testNumber, TestCase* tc, Output& out){
+    // Print the test number and algorithm name to match output for gantt "chart".
+    out << testNumber << " " << tc->algorithm << '\n';
+    // processes by arrival time, ascending. SortedArrivals acts as a cursor over the processes that have not arrived yet.
+    int* order = sortedByArrival(tc);
+    EngineState<Policy> state(&tc->procs);
+    GanttWriter gantt(out, tc->trace, tc->options);
+    SortedArrivals arrivals(tc, order, state.idx);
+    simulate<Policy>(tc, arrivals, state, gantt, nullptr);
+    gantt.finish();
+    printResults(testNumber, tc, out);
+}
+
+// Continues the test case of a --resume snapshot, whose process table is already in tc.
+template <typename Policy>
+void resumeEngine(int testNumber, TestCase* tc, Output& out, const SnapshotHeader& h, const vector<int>& queue){
+    int* order = sortedByArrival(tc);
+    EngineState<Policy> state(&tc->procs);
+    state.currentTime = h.currentTime;
+    state.idx = h.idx;
+    state.completed = h.completed;
+    state.ready_queue.restore(queue);
+    tc->decisions = h.decisions;
+    GanttWriter gantt(out, tc->trace, tc->options);
+    SortedArrivals arrivals(tc, order, state.idx);
+    simulate<Policy>(tc, arrivals, state, gantt, nullptr);
+    gantt.finish();
+    printResults(testNumber, tc, out);
+}
+
+/*
+Checkpoints of a runEngine simulation for --what-if. Before the changed process arrives nothing
+in the schedule depends on its burst or nice level, so a changed copy of the test case can resume
+from the last checkpoint taken before that process was queued and only simulate the rest.
+A checkpoint is the EngineState plus the remaining, start and completion times of every process,
+how much Gantt output had been written and the GanttWriter as it was then. At most MAX are kept: once they are all used, every
+other one is dropped and the interval doubles, so they stay spread over the whole run.
+*/
+template <typename Policy>
+struct EngineCheckpoints {
+    static const size_t MAX = 16;
+
+    struct Checkpoint {
+        EngineState<Policy> state;
+        long long decisions;
+        size_t outSize;
+        GanttWriter gantt;
+        vector<Time> remaining;
+        vector<Time> start_time;
+        vector<Time> completion_time;
+    };
+
+    vector<Checkpoint> saved;
+    long long interval;   // decisions between two checkpoints
+    long long next;       // decision count at which the next one is due
+
+    // Every process takes at least one decision, so n / MAX keeps the first ones from being thinned out right away.
+    EngineCheckpoints(int n){
+        this->interval = max(256, n / (int)MAX);
+        this->next = 0;
+    }
+
+    void save(const TestCase* tc, const EngineState<Policy>& state, const GanttWriter& gantt){
+        if (saved.size() == MAX){
+            for (size_t i = 1; i < MAX / 2; i++){
+                saved[i] = move(saved[2 * i]);
+            }
+            saved.erase(saved.begin() + MAX / 2, saved.end());
+            interval *= 2;
+        }
+        const ProcessTable& t = tc->procs;
+        int n = tc->size;
+        saved.push_back(Checkpoint{state, tc->decisions, gantt.out->size, gantt,
+                                   vector<Time>(t.remaining, t.remaining + n),
+                                   vector<Time>(t.start_time, t.start_time + n),
+                                   vector<Time>(t.completion_time, t.completion_time + n)});
+        next = tc->decisions + interval;
+    }
+
+    // Latest checkpoint taken before the process at position pos of the arrival order was queued.
+    // The first one is taken before anything is queued, so there always is one.
+    const Checkpoint& before(int pos) const {
+        size_t k = 0;
+        while (k + 1 < saved.size() && saved[k + 1].state.idx <= pos){
+            k++;
+        }
+        return saved[k];
+    }
+
+    // Puts tc back in the state it had at checkpoint c.
+    void restore(TestCase* tc, const Checkpoint& c, EngineState<Policy>& state) const {
+        ProcessTable& t = tc->procs;
+        copy(c.remaining.begin(), c.remaining.end(), t.remaining);
+        copy(c.start_time.begin(), c.start_time.end(), t.start_time);
+        copy(c.completion_time.begin(), c.completion_time.end(), t.completion_time);
+        tc->decisions = c.decisions;
+        state = c.state;
+    }
+};
+
+/*
+--what-if: runs the test case as usual while taking checkpoints, then for every change to one of
+its processes prints the whole output again, headed "n ALG what-if process P FIELD VALUE". The
+Gantt chart up to the checkpoint is copied from the first run and only the rest is simulated.
+*/
+template <typename Policy>
+void runWhatIf(int testNumber, TestCase* tc, Output& out){
+    out << testNumber << " " << tc->algorithm << '\n';
+    int n = tc->size;
+    ProcessTable& t = tc->procs;
+    int* order = sortedByArrival(tc);
+    EngineCheckpoints<Policy> checkpoints(n);
+    Output chart(Output::MEMORY, 1 << 16);
+    GanttWriter gantt(chart, tc->trace, tc->options);
+    EngineState<Policy> state(&t);
+    SortedArrivals arrivals(tc, order, state.idx);
+    simulate<Policy>(tc, arrivals, state, gantt, &checkpoints);
+    gantt.finish();
+    out.write(chart.buffer, chart.size);
+    printResults(testNumber, tc, out);
+
+    for (const WhatIf& change : tc->options.whatIf){
+        if (change.test != testNumber) continue;
+        int p = change.process - 1;
+        if (p < 0 || p >= n){
+            cerr << "what-if: test case " << testNumber << " has no process " << change.process << endl;
+            continue;
+        }
+        bool burst = change.field == "burst";
+        TimeSpan span = tc->span;
+        if (burst && !span.add(0, (long long)change.value - t.burst[p])){
+            cerr << "what-if: " << timeOverflow(testNumber) << " with process " << change.process << " burst "
+                 << change.value << endl;
+            continue;
+        }
+        int pos = find(order, order + n, p) - order;
+        checkpoints.restore(tc, checkpoints.before(pos), state);
+        Time originalBurst = t.burst[p];
+        int originalNice = t.nice[p];
+        if (burst){
+            t.burst[p] = change.value;
+        } else {
+            t.nice[p] = change.value;
+        }
+        t.remaining[p] = t.burst[p];
+
+        out << testNumber << " " << tc->algorithm << " what-if process " << change.process << " "
+            << change.field << " " << change.value << '\n';
+        const typename EngineCheckpoints<Policy>::Checkpoint& from = checkpoints.before(pos);
+        out.write(chart.buffer, from.outSize);
+        GanttWriter rerun = from.gantt;
+        rerun.out = &out;
+        SortedArrivals rest(tc, order, state.idx);
+        simulate<Policy>(tc, rest, state, rerun, nullptr);
+        rerun.finish();
+        printResults(testNumber, tc, out);
+        t.burst[p] = originalBurst;
+        t.nice[p] = originalNice;
+    }
+}
+
+/*
+Load weight for each nice level from -20 to 19, the table the Linux scheduler uses: every nice
+level is worth about 10% of CPU time, and nice 0 weighs 1024.
+*/
+const int NICE_0_WEIGHT = 1024;
+const int NICE_TO_WEIGHT[40] = {
+    88761, 71755, 56483, 46273, 36291,
+    29154, 23254, 18705, 14949, 11916,
+     9548,  7620,  6100,  4904,  3906,
+     3121,  2501,  1991,  1586,  1277,
+     1024,   820,   655,   526,   423,
+      335,   272,   215,   172,   137,
+      110,    87,    70,    56,    45,
+       36,    29,    23,    18,    15,
+};
+
+int niceWeight(int nice){
+    return NICE_TO_WEIGHT[min(max(nice, -20), 19) + 20];
+}
+
+// Largest total burst of a CFS test case. No vruntime gets larger than every run so far scaled
+// by NICE_0_WEIGHT / weight, at most total burst * NICE_0_WEIGHT / 15, which has to fit in a long long.
+const long long CFS_MAX_TOTAL_BURST = LLONG_MAX / NICE_0_WEIGHT * NICE_TO_WEIGHT[39];
+
+// The parser's message for a CFS test case above CFS_MAX_TOTAL_BURST.
+string cfsOverflow(int testNumber){
+    return "test case " + to_string(testNumber) + " is too long for CFS, whose virtual runtimes need the total burst to be at most "
+        + to_string(CFS_MAX_TOTAL_BURST) + "ns";
+}
+
+// Gantt options for runCFS and runMLFQ, which print consecutive slices of a process as one block:
+// the slices are handed to the GanttWriter one by one and it merges them.
+SimOptions blockOptions(const SimOptions& options){
+    SimOptions blocks = options;
+    blocks.ganttMerge = true;
+    return blocks;
+}
+
+/*
+Completely Fair Scheduler, modelled on Linux CFS. Every process accumulates virtual runtime,
+the time it ran scaled by NICE_0_WEIGHT / weight, so lower nice levels age more slowly and get
+a larger share of the CPU. The runnable processes sit in a red-black tree (std::set) keyed on
+(vruntime, arrival, id) and the leftmost one runs next.
+  - The scheduling period is the target latency, stretched to nr_running * minimum granularity
+    when there are too many processes; each process gets a slice of it proportional to its weight.
+  - A newly arrived process starts at min_vruntime, so it cannot claim the time that passed before
+    it arrived.
+  - Arrivals do not preempt the running slice. When the running process is alone it runs until it
+    finishes or the next process arrives, so time always jumps from event to event.
+Consecutive slices of the same process are printed as one Gantt block.
+*/
+void runCFS(int testNumber, TestCase* tc, Output& out){
+    out << testNumber << " " << tc->algorithm << '\n';
+    GanttWriter gantt(out, tc->trace, blockOptions(tc->options));
+    int n = tc->size;
+    ProcessTable& t = tc->procs;
+    long long latency = tc->options.cfsLatency;
+    long long granularity = tc->options.cfsGranularity;
+
+    int* order = sortedByArrival(tc);
+    long long* vruntime = tc->arena.allocate<long long>(n);
+    int* weight = tc->arena.allocate<int>(n);
+    for (int i = 0; i < n; i++){
+        weight[i] = niceWeight(t.nice[i]);
+    }
+
+    typedef tuple<long long, Time, int> Key;   // (vruntime, arrival, index)
+    set<Key> tree;
+    long long treeWeight = 0;
+    long long minVruntime = 0;
+
+    int idx = 0;
+    int completed = 0;
+    Time currentTime = 0;
+
+    while (completed < n){
+        // admit arrivals at min_vruntime
+        while (idx < n && t.arrival[order[idx]] <= currentTime){
+            int p = order[idx++];
+            vruntime[p] = minVruntime;
+            tree.emplace(vruntime[p], t.arrival[p], p);
+            treeWeight += weight[p];
+            STAT_ADD(tc->stats, pushes, 1);
+        }
+
+        if (tree.empty()){
+            STAT_ADD(tc->stats, idleJumps, 1);
+            STAT_ADD(tc->stats, idleTime, (long long)t.arrival[order[idx]] - currentTime);
+            currentTime = t.arrival[order[idx]];
+            continue;
+        }
+
+        // leftmost process runs next
+        int p = get<2>(*tree.begin());
+        tree.erase(tree.begin());
+        STAT_ADD(tc->stats, pops, 1);
+        long long runnableWeight = treeWeight;
+        treeWeight -= weight[p];
+        STAT_SWITCH(tc->stats, p);
+        tc->decisions++;
+
+        if (t.start_time[p] == -1){
+            t.start_time[p] = currentTime;
+        }
+
+        long long runFor;
+        if (tree.empty()){
+            // alone: run to completion or until the next arrival
+            runFor = t.remaining[p];
+            if (idx < n){
+                runFor = min(runFor, (long long)t.arrival[order[idx]] - currentTime);
+            }
+        } else {
+            long long nrRunning = tree.size() + 1;
+            long long period = max(latency, nrRunning * granularity);
+            long long slice = max(1LL, (long long)((__int128)period * weight[p] / runnableWeight));
+            runFor = min((long long)t.remaining[p], slice);
+        }
+
+        t.remaining[p] -= runFor;
+        // runFor * NICE_0_WEIGHT alone can overflow; the result fits, see CFS_MAX_TOTAL_BURST
+        vruntime[p] += (long long)((__int128)runFor * NICE_0_WEIGHT / weight[p]);
+        gantt.segment(currentTime, t.id(p), runFor, t.remaining[p] == 0);
+        STAT_ADD(tc->stats, segments, 1);
+        currentTime += runFor;
+
+        if (t.remaining[p] == 0){
+            t.completion_time[p] = currentTime;
+            completed++;
+        } else {
+            tree.emplace(vruntime[p], t.arrival[p], p);
+            treeWeight += weight[p];
+            STAT_ADD(tc->stats, pushes, 1);
+            STAT_ADD(tc->stats, preemptions, 1);
+        }
+
+        // min_vruntime only moves forward
+        if (!tree.empty()){
+            minVruntime = max(minVruntime, get<0>(*tree.begin()));
+        }
+    }
+    gantt.finish();
+    printResults(testNumber, tc, out);
+}
+
+/*
+Per-level run queues for runMLFQ. Each level is an intrusive circular singly-linked list threaded
+through next[] (one slot per process) and identified by its tail, so tail's successor is the head.
+Push at either end, pop from the head and appending a whole level to another are all O(1), and the
+bitmap of non-empty levels finds the highest-priority level with a single count-trailing-zeros.
+*/
+struct MLFQLevels {
+    static const int MAX_LEVELS = 64;
+    int* next;
+    int tail[MAX_LEVELS];
+    unsigned long long nonEmpty;
+
+    MLFQLevels(int* next){
+        this->next = next;
+        this->nonEmpty = 0;
+        for (int l = 0; l < MAX_LEVELS; l++){
+            tail[l] = -1;
+        }
+    }
+
+    bool empty() const {
+        return nonEmpty == 0;
+    }
+
+    int highest() const {
+        return __builtin_ctzll(nonEmpty);
+    }
+
+    void pushBack(int level, int p){
+        pushFront(level, p);
+        tail[level] = p;
+    }
+
+    void pushFront(int level, int p){
+        if (tail[level] == -1){
+            next[p] = p;
+            tail[level] = p;
+            nonEmpty |= 1ULL << level;
+        } else {
+            next[p] = next[tail[level]];
+            next[tail[level]] = p;
+        }
+    }
+
+    int popFront(int level){
+        int head = next[tail[level]];
+        if (head == tail[level]){
+            tail[level] = -1;
+            nonEmpty &= ~(1ULL << level);
+        } else {
+            next[tail[level]] = next[head];
+        }
+        return head;
+    }
+
+    // Appends every process of level from to the back of level 0.
+    void moveToTop(int from){
+        if (tail[from] == -1) return;
+        if (tail[0] == -1){
+            tail[0] = tail[from];
+        } else {
+            int head0 = next[tail[0]];
+            next[tail[0]] = next[tail[from]];
+            next[tail[from]] = head0;
+            tail[0] = tail[from];
+        }
+        tail[from] = -1;
+        nonEmpty = (nonEmpty & ~(1ULL << from)) | 1;
+    }
+};
+
+/*
+Multi-level feedback queue. New processes enter level 0; the highest non-empty level always runs
+and each level is round robin with its own quantum (--mlfq-quanta, the last one doubling for any
+further levels).
+  - Using up the whole quantum of a level demotes the process one level.
+  - An arrival preempts a process running below level 0. The preempted process goes back to the
+    front of its level and keeps what it already used of its quantum.
+  - Every --mlfq-boost ns all processes go back to level 0 (0 disables the boost), so long jobs
+    cannot starve. The boost appends the lower levels to level 0 in O(levels), and processes
+    record the boost epoch they were queued in, so their level and quantum use read as 0 after
+    a boost without touching each process.
+Consecutive slices of the same process are printed as one Gantt block.
+*/
+void runMLFQ(int testNumber, TestCase* tc, Output& out){
+    out << testNumber << " " << tc->algorithm << '\n';
+    GanttWriter gantt(out, tc->trace, blockOptions(tc->options));
+    int n = tc->size;
+    ProcessTable& t = tc->procs;
+    const SimOptions& options = tc->options;
+    int levels = min(options.mlfqLevels, (int)MLFQLevels::MAX_LEVELS);
+    long long boostPeriod = options.mlfqBoost;
+
+    long long quanta[MLFQLevels::MAX_LEVELS];
+    int given = options.mlfqQuanta.size();
+    for (int l = 0; l < levels; l++){
+        if (l < given){
+            quanta[l] = options.mlfqQuanta[l];
+        } else {
+            // doubled one level at a time, up to the largest time
+            quanta[l] = quanta[l - 1] > TIME_MAX / 2 ? TIME_MAX : 2 * quanta[l - 1];
+        }
+    }
+
+    int* order = sortedByArrival(tc);
+    MLFQLevels queues(tc->arena.allocate<int>(n));
+    Time* used = tc->arena.allocate<Time>(n);     // time used of the current level's quantum
+    long long* epoch = tc->arena.allocate<long long>(n);
+    long long boostEpoch = 0;
+    long long nextBoost = boostPeriod > 0 ? boostPeriod : LLONG_MAX;
+
+    int idx = 0;
+    int completed = 0;
+    Time currentTime = 0;
+
+    while (completed < n){
+        while (idx < n && t.arrival[order[idx]] <= currentTime){
+            int p = order[idx++];
+            used[p] = 0;
+            epoch[p] = boostEpoch;
+            queues.pushBack(0, p);
+            STAT_ADD(tc->stats, pushes, 1);
+        }
+
+        if (currentTime >= nextBoost){
+            for (int l = 1; l < levels; l++){
+                queues.moveToTop(l);
+            }
+            boostEpoch++;
+            nextBoost = (currentTime / boostPeriod + 1) * boostPeriod;
+        }
+
+        if (queues.empty()){
+            STAT_ADD(tc->stats, idleJumps, 1);
+            STAT_ADD(tc->stats, idleTime, (long long)t.arrival[order[idx]] - currentTime);
+            currentTime = t.arrival[order[idx]];
+            continue;
+        }
+
+        int l = queues.highest();
+        int p = queues.popFront(l);
+        STAT_ADD(tc->stats, pops, 1);
+        if (epoch[p] != boostEpoch){
+            used[p] = 0;
+            epoch[p] = boostEpoch;
+        }
+        STAT_SWITCH(tc->stats, p);
+        tc->decisions++;
+
+        if (t.start_time[p] == -1){
+            t.start_time[p] = currentTime;
+        }
+
+        // run until the quantum is used up, the process finishes, the next boost, or an arrival
+        // if it is running below level 0
+        long long runUntil = currentTime + min((long long)t.remaining[p], quanta[l] - used[p]);
+        runUntil = min(runUntil, nextBoost);
+        if (l > 0 && idx < n && t.arrival[order[idx]] < runUntil){
+            runUntil = t.arrival[order[idx]];
+        }
+
+        Time ran = runUntil - currentTime;
+        t.remaining[p] -= ran;
+        used[p] += ran;
+        gantt.segment(currentTime, t.id(p), ran, t.remaining[p] == 0);
+        STAT_ADD(tc->stats, segments, 1);
+        currentTime = runUntil;
+
+        if (t.remaining[p] == 0){
+            t.completion_time[p] = currentTime;
+            completed++;
+        }
+        else if (used[p] >= quanta[l]){
+            used[p] = 0;
+            queues.pushBack(min(l + 1, levels - 1), p);
+            STAT_ADD(tc->stats, pushes, 1);
+            STAT_ADD(tc->stats, preemptions, 1);
+        }
+        else {
+            // preempted by an arrival or by the boost
+            queues.pushFront(l, p);
+            STAT_ADD(tc->stats, pushes, 1);
+            STAT_ADD(tc->stats, preemptions, 1);
+        }
+    }
+    gantt.finish();
+    printResults(testNumber, tc, out);
+}
+
+/*
+One simulated CPU for runSMP: the process it is running, its own ready queue and its own Gantt lines.
+*/
+template <typename Policy>
+struct Core {
+    int running;                  // process index, -1 when idle
+    Time segmentStart;
+    Time runUntil;
+    long long sequence;           // bumped on preemption so stale end events can be told apart
+    long long busy;
+    long long completed;
+    typename Policy::Queue ready_queue;
+    Output gantt;
+    GanttTrace trace;   // used instead of gantt with --trace
+    GanttWriter writer;
+    Stats stats;        // context switches of this core
+
+    Core(const ProcessTable* t, bool tracing, const SimOptions& options)
+        : ready_queue(t), gantt(Output::MEMORY, 1 << 12), trace(Output::MEMORY, 1 << 12),
+          writer(gantt, tracing ? &trace : nullptr, options){
+        this->running = -1;
+        this->segmentStart = 0;
+        this->runUntil = 0;
+        this->sequence = 0;
+        this->busy = 0;
+        this->completed = 0;
+    }
+};
+
+/*
+Multi-CPU simulation (--cpus N). Every core runs the test case's policy on its own ready queue:
+  - an arriving process goes to an idle core if there is one, otherwise to the core with the
+    fewest queued processes; under SRTF and P it preempts that core's process if it outranks it,
+  - a core whose queue runs dry steals the next process of the core with the longest queue.
+Time advances from event to event (arrivals and segment ends); segment ends sit in a min-heap,
+so each event costs O(log n + N) no matter how long the bursts are.
+At any time t, segments ending at t are handled first, then arrivals at t, then idle cores pick
+work, which with one CPU reproduces the uniprocessor schedule exactly.
+Each core's Gantt chart is printed under its own "CPU k:" heading, followed by the usual
+metrics and per-core utilization and throughput.
+*/
+template <typename Policy>
+void runSMP(int testNumber, TestCase* tc, Output& out){
+    out << testNumber << " " << tc->algorithm << '\n';
+    int n = tc->size;
+    int cpus = tc->options.cpus;
+    ProcessTable& t = tc->procs;
+
+    vector<Core<Policy>> cores;
+    cores.reserve(cpus);
+    for (int c = 0; c < cpus; c++){
+        cores.emplace_back(&t, tc->trace != nullptr, tc->options);
+    }
+
+    // (runUntil, core, sequence) of every running segment, earliest first
+    typedef tuple<Time, int, long long> EndEvent;
+    priority_queue<EndEvent, vector<EndEvent>, greater<EndEvent>> ends;
+
+    int* order = sortedByArrival(tc);
+    int idx = 0;
+    int completed = 0;
+    size_t totalQueued = 0;   // processes waiting in any core's queue
+
+    auto enqueue = [&](Core<Policy>& core, int p, bool isNew){
+        totalQueued++;
+        core.ready_queue.push(p, isNew);
+        STAT_ADD(tc->stats, pushes, 1);
+    };
+    auto dequeue = [&](Core<Policy>& core){
+        totalQueued--;
+        STAT_ADD(tc->stats, pops, 1);
+        return core.ready_queue.pop();
+    };
+    // Closes the running segment of core at time now and prints it.
+    auto closeSegment = [&](Core<Policy>& core, Time now){
+        int p = core.running;
+        Time duration = now - core.segmentStart;
+        t.remaining[p] -= duration;
+        core.busy += duration;
+        core.writer.segment(core.segmentStart, t.id(p), duration, t.remaining[p] == 0);
+        STAT_ADD(tc->stats, segments, 1);
+        STAT_ADD(tc->stats, preemptions, t.remaining[p] > 0);
+        if (t.remaining[p] == 0){
+            t.completion_time[p] = now;
+            core.completed++;
+            completed++;
+        }
+        core.running = -1;
+        core.sequence++;
+        return p;
+    };
+
+    while (completed < n){
+        Time nextArrival = idx < n ? t.arrival[order[idx]] : TIME_MAX;
+        // drop end events of segments that were preempted
+        while (!ends.empty()){
+            const Core<Policy>& core = cores[get<1>(ends.top())];
+            if (core.running != -1 && core.sequence == get<2>(ends.top())) break;
+            ends.pop();
+        }
+        Time now = ends.empty() ? nextArrival : min(nextArrival, get<0>(ends.top()));
+
+        // 1. segments ending now: completions and RR quantum expiries
+        while (!ends.empty() && get<0>(ends.top()) == now){
+            Core<Policy>& core = cores[get<1>(ends.top())];
+            bool stale = core.running == -1 || core.sequence != get<2>(ends.top());
+            ends.pop();
+            if (stale) continue;
+            int p = closeSegment(core, now);
+            if (t.remaining[p] > 0){
+                enqueue(core, p, false);
+            }
+        }
+
+        // 2. arrivals: an idle core first, else the shortest queue, preempting if the newcomer outranks
+        while (idx < n && t.arrival[order[idx]] <= now){
+            int p = order[idx++];
+            int target = 0;
+            for (int c = 0; c < cpus; c++){
+                size_t load = cores[c].ready_queue.size() + (cores[c].running != -1);
+                size_t best = cores[target].ready_queue.size() + (cores[target].running != -1);
+                if (load < best) target = c;
+            }
+            Core<Policy>& core = cores[target];
+            if (Policy::preemptive && core.running != -1){
+                int q = core.running;
+                Time remainingNow = t.remaining[q] - (now - core.segmentStart);
+                Time saved = t.remaining[q];
+                t.remaining[q] = remainingNow;
+                bool preempt = Policy::outranks(&t, p, q);
+                t.remaining[q] = saved;
+                if (preempt){
+                    closeSegment(core, now);
+                    enqueue(core, q, false);
+                }
+            }
+            enqueue(core, p, true);
+        }
+
+        // 3. idle cores take work from their own queue, or steal from the longest one
+        for (int c = 0; c < cpus && totalQueued > 0; c++){
+            Core<Policy>& core = cores[c];
+            if (core.running != -1) continue;
+            Core<Policy>* from = &core;
+            if (core.ready_queue.size() == 0){
+                for (int v = 0; v < cpus; v++){
+                    if (cores[v].ready_queue.size() > from->ready_queue.size()) from = &cores[v];
+                }
+                if (from->ready_queue.size() == 0) continue;
+            }
+            int p = dequeue(*from);
+            STAT_SWITCH(core.stats, p);
+            if (t.start_time[p] == -1){
+                t.start_time[p] = now;
+            }
+            tc->decisions++;
+            core.running = p;
+            core.segmentStart = now;
+            core.runUntil = now + (Policy::timeSliced ? min(tc->quantum, t.remaining[p]) : t.remaining[p]);
+            ends.emplace(core.runUntil, c, core.sequence);
+        }
+    }
+
+    for (int c = 0; c < cpus; c++){
+        cores[c].writer.finish();
+        if (tc->trace){
+            tc->trace->cpu(c);
+            tc->trace->append(cores[c].trace);
+            continue;
+        }
+        out << "CPU " << c << ":" << '\n';
+        out.write(cores[c].gantt.buffer, cores[c].gantt.size);
+    }
+    printResults(testNumber, tc, out);
+
+    Time totalTime = 0;
+    for (int i = 0; i < n; i++){
+        totalTime = max(totalTime, t.completion_time[i]);
+    }
+    for (int c = 0; c < cpus; c++){
+        STAT_ADD(tc->stats, switches, cores[c].stats.switches);
+        STAT_ADD(tc->stats, idleTime, (long long)totalTime - cores[c].busy);
+    }
+    for (int c = 0; c < cpus; c++){
+        out << "CPU " << c << " utilization: " << (int)((double)cores[c].busy / totalTime * 100) << "%"
+            << ", throughput: " << (double)cores[c].completed / totalTime << " processes/ns" << '\n';
+    }
+}
+
+// Whether name is one of the algorithms a test case header can name.
+bool isAlgorithm(const string& name){
+    return name == "FCFS" || name == "SJF" || name == "SRTF" || name == "P" || name == "RR" || name == "CFS"
+        || name == "MLFQ";
+}
+
+/*
+Reads the "n ALG [Q]" line of a test case and returns n. minCount is -1 in streaming mode,
+where it stands for "until the end of the input".
+For RR, Q can also be a sweep "first..last [step s]": quantum is then first, quantumLast is last
+and quantumStep is s (1 if not given). quantumStep is 0 for a single quantum. A sweep may have at
+most MAX_SWEEP_ROWS quanta, since each one is a full simulation and a row of the table.
+*/
+const long long MAX_SWEEP_ROWS = 100000;
+
+long long readTestCaseHeader(InputReader& in, int testNumber, long long minCount, string& algorithm, Time& quantum,
+                             Time& quantumLast, Time& quantumStep){
+    in.contextTest = testNumber;
+    in.contextProcess = 0;
+    long long num_process = in.readInt("number of processes", minCount, INT_MAX);
+    algorithm = in.readWord("algorithm name");
+    if (!isAlgorithm(algorithm)){
+        in.fail("unknown algorithm '" + algorithm + "' for test case " + to_string(testNumber));
+    }
+
+    //Read time quantum if Round Robin
+    quantum = 0;
+    quantumLast = 0;
+    quantumStep = 0;
+    if (algorithm == "RR"){
+        long long first, last;
+        int headerLine = in.line;
+        if (in.readRange("time quantum", 1, TIME_MAX, first, last)){
+            quantumStep = in.skipWord("step") ? in.readInt("sweep step", 1, TIME_MAX) : 1;
+            // first <= last are both positive, so the difference cannot overflow
+            long long rows = (last - first) / quantumStep + 1;
+            if (rows > MAX_SWEEP_ROWS){
+                // looking for "step" may have moved past the end of the header
+                in.line = headerLine;
+                in.fail("quantum sweep of test case " + to_string(testNumber) + " has " + to_string(rows)
+                        + " quanta, at most " + to_string(MAX_SWEEP_ROWS) + " are allowed");
+            }
+        }
+        quantum = first;
+        quantumLast = last;
+    }
+    return num_process;
+}
+
+/*
+Reads one test case (header line and its processes) from the input into testCase,
+reusing whatever memory it holds from the previous test case.
+*/
+void readTestCase(InputReader& in, int testNumber, TestCase* testCase, const SimOptions& options){
+    string algorithm;
+    Time quantum, quantumLast, quantumStep;
+    int num_process = readTestCaseHeader(in, testNumber, 0, algorithm, quantum, quantumLast, quantumStep);
+    if (options.cpus > 1 && (algorithm == "CFS" || algorithm == "MLFQ")){
+        in.fail(algorithm + " is not supported with --cpus");
+    }
+    // Every process takes at least 6 bytes ("a b c" and a separator), so a count the rest of a
+    // mapped input cannot hold is reported here instead of allocating the table for it.
+    if (in.mapped != nullptr && num_process > (in.end - in.cur + 1) / 6){
+        in.fail("test case " + to_string(testNumber) + " has " + to_string(num_process)
+                + " processes, more than the rest of the input can hold");
+    }
+    testCase->reset(num_process, algorithm);
+    testCase->quantum = quantum;
+    testCase->quantumLast = quantumLast;
+    testCase->quantumStep = quantumStep;
+    testCase->options = options;
+
+    // Iterates through each process per test case
+    for (int j = 0; j < num_process; j++){
+        in.contextProcess = j+1;
+        Time arrival = in.readInt("arrival time", TIME_MIN, TIME_MAX);
+        Time burst = in.readInt("burst time", 0, TIME_MAX);
+        int nice = in.readInt("nice level", INT_MIN, INT_MAX);
+        if (!testCase->span.add(arrival, burst)){
+            in.fail(timeOverflow(testNumber));
+        }
+        testCase->procs.set(j, arrival, burst, nice);
+    }
+    if (algorithm == "CFS" && testCase->span.totalBurst > CFS_MAX_TOTAL_BURST){
+        in.fail(cfsOverflow(testNumber));
+    }
+}
+
+bool hasWhatIf(int testNumber, const SimOptions& options){
+    for (const WhatIf& change : options.whatIf){
+        if (change.test == testNumber) return true;
+    }
+    return false;
+}
+
+// Runs a policy on one CPU or, with --cpus, on several.
+template <typename Policy>
+void runPolicy(int testNumber, TestCase* tc, Output& out){
+    if (tc->options.cpus > 1){
+        runSMP<Policy>(testNumber, tc, out);
+    } else if (hasWhatIf(testNumber, tc->options)){
+        runWhatIf<Policy>(testNumber, tc, out);
+    } else {
+        runEngine<Policy>(testNumber, tc, out);
+    }
+}
+
+/*
+One row of a quantum sweep table, the average and tail of each of waiting, turnaround and
+response time, in that order.
+*/
+struct SweepRow {
+    Time quantum;
+    int cpuUtil;
+    double throughput;
+    long long decisions;
+    double average[3];
+    long long p95[3];
+    long long p99[3];
+};
+
+/*
+RR quantum sweep, "n RR first..last [step s]" in the input. The processes are parsed once. Every
+quantum is simulated on its own copy of the remaining-time and metric arrays (the input arrays are
+shared, see TestCase::resetFrom), and the quanta are spread over one thread per hardware thread.
+Instead of Gantt charts and per-process lists, one table row per quantum is printed.
+*/
+void runSweep(int testNumber, TestCase* tc, Output& out){
+    // bounded by MAX_SWEEP_ROWS in readTestCaseHeader; every quantum is at most quantumLast
+    size_t count = (size_t)((tc->quantumLast - tc->quantum) / tc->quantumStep + 1);
+    vector<Time> quanta(count);
+    for (size_t k = 0; k < count; k++){
+        quanta[k] = tc->quantum + (Time)k * tc->quantumStep;
+    }
+    vector<SweepRow> rows(quanta.size());
+    atomic<size_t> next(0);
+    // sorted once here, before the copies share it
+    sortedByArrival(tc);
+
+    auto work = [&](){
+        TestCase copy;
+        // the rest of the usual output is not needed either
+        Output discard(Output::DISCARD, 1 << 16);
+        LatencyHistogram latency[3];
+        for (size_t k = next++; k < quanta.size(); k = next++){
+            copy.resetFrom(*tc);
+            copy.quantum = quanta[k];
+            copy.options.summary = true;
+            copy.options.gantt = false;
+            copy.options.whatIf.clear();
+            runPolicy<RoundRobinPolicy>(testNumber, &copy, discard);
+            discard.clear();
+
+            const ProcessTable& t = copy.procs;
+            long long totalBurst = 0;
+            Time totalTime = 0;
+            for (int h = 0; h < 3; h++){
+                latency[h].clear();
+            }
+            for (int i = 0; i < copy.size; i++){
+                totalBurst += t.burst[i];
+                totalTime = max(totalTime, t.completion_time[i]);
+                latency[0].record(t.waiting_time[i]);
+                latency[1].record(t.turnaround_time[i]);
+                latency[2].record(t.response_time[i]);
+            }
+            SweepRow& row = rows[k];
+            row.quantum = quanta[k];
+            row.cpuUtil = (int)((double)totalBurst / ((double)totalTime * copy.options.cpus) * 100);
+            row.throughput = (double)copy.size / totalTime;
+            row.decisions = copy.decisions;
+            for (int h = 0; h < 3; h++){
+                row.average[h] = (double)latency[h].sum / latency[h].total;
+                row.p95[h] = latency[h].percentile(95);
+                row.p99[h] = latency[h].percentile(99);
+            }
+        }
+    };
+    size_t threads = min((size_t)max(1u, thread::hardware_concurrency()), quanta.size());
+    vector<thread> workers;
+    for (size_t w = 1; w < threads; w++){
+        workers.emplace_back(work);
+    }
+    work();
+    for (thread& w : workers){
+        w.join();
+    }
+
+    out << testNumber << " " << tc->algorithm << '\n';
+    char line[256];
+    snprintf(line, sizeof line, "%7s %5s %11s %10s %8s %8s %10s %8s %8s %10s %8s %8s %10s\n",
+             "quantum", "util%", "throughput", "wait avg", "p95", "p99", "turn avg", "p95", "p99",
+             "resp avg", "p95", "p99", "decisions");
+    out << line;
+    for (const SweepRow& row : rows){
+        snprintf(line, sizeof line, "%7lld %5d %11.4g %10.1f %8lld %8lld %10.1f %8lld %8lld %10.1f %8lld %8lld %10lld\n",
+                 (long long)row.quantum, row.cpuUtil, row.throughput,
+                 row.average[0], row.p95[0], row.p99[0], row.average[1], row.p95[1], row.p99[1],
+                 row.average[2], row.p95[2], row.p99[2], row.decisions);
+        out << line;
+    }
+}
+
+void runTestCase(int testNumber, TestCase* tc, Output& out){
+    if ((tc->algorithm == "CFS" || tc->algorithm == "MLFQ" || tc->quantumStep > 0) && hasWhatIf(testNumber, tc->options)){
+        cerr << "what-if: not supported for test case " << testNumber << ", running it as usual" << endl;
+    }
+    if (tc->trace){
+        tc->trace->testCase(testNumber, tc->algorithm);
+    }
+    if (tc->algorithm == "FCFS"){
+        runPolicy<FCFSPolicy>(testNumber, tc, out);
+    }
+    else if (tc->algorithm == "SRTF"){
+        runPolicy<SRTFPolicy>(testNumber, tc, out);
+    } else if (tc->algorithm == "SJF"){
+        runPolicy<SJFPolicy>(testNumber, tc, out);
+    } else if (tc->algorithm == "P"){
+        runPolicy<PrioPolicy>(testNumber, tc, out);
+    } 
+    else if (tc->algorithm == "RR" && tc->quantumStep > 0){
+        runSweep(testNumber, tc, out);
+    }
+    else if (tc->algorithm == "RR"){
+        runPolicy<RoundRobinPolicy>(testNumber, tc, out);
+    }
+    else if (tc->algorithm == "CFS"){
+        runCFS(testNumber, tc, out);
+    }
+    else if (tc->algorithm == "MLFQ"){
+        runMLFQ(testNumber, tc, out);
+    }
+}
+
+/*
+--stats: one JSON object per line for every test case. simulate_ns is the time in the run* function
+without printResults; output_ns is printResults plus writing the test case out (not measured with
+--jobs, where the main thread writes the output of several test cases together).
+*/
+void writeStats(Output& out, int testNumber, const string& algorithm, long long processes, long long decisions,
+                const Stats& s){
+    out << "{\"test\": " << testNumber << ", \"algorithm\": \"" << algorithm << "\", \"processes\": " << processes
+        << ", \"decisions\": " << decisions << ", \"queue_pushes\": " << s.pushes << ", \"queue_pops\": " << s.pops
+        << ", \"preemptions\": " << s.preemptions << ", \"context_switches\": " << s.switches
+        << ", \"segments\": " << s.segments << ", \"idle_jumps\": " << s.idleJumps << ", \"idle_time\": " << s.idleTime
+        << ", \"parse_ns\": " << s.parseNs << ", \"simulate_ns\": " << s.runNs - s.printNs
+        << ", \"output_ns\": " << s.printNs + s.flushNs << "}" << '\n';
+}
+
+/*
+Bounded lock-free ring buffer (Vyukov's sequence-numbered cells). Any number of threads may push
+and pop, so the same type serves as the SPSC, SPMC and MPSC queues of the --jobs pipeline. Each
+cell carries a sequence number: a pusher waits for seq == pos, a popper for seq == pos + 1, and the
+position counters are only advanced with a CAS. The capacity is rounded up to a power of two.
+*/
+template <typename T>
+struct Ring {
+    struct Cell {
+        atomic<size_t> seq;
+        T value;
+    };
+
+    Cell* cells;
+    size_t mask;
+    alignas(64) atomic<size_t> head;   // next position to push
+    alignas(64) atomic<size_t> tail;   // next position to pop
+
+    Ring(size_t capacity){
+        size_t size = 1;
+        while (size < capacity) size <<= 1;
+        this->cells = new Cell[size];
+        this->mask = size - 1;
+        for (size_t i = 0; i < size; i++){
+            cells[i].seq.store(i, memory_order_relaxed);
+        }
+        head.store(0, memory_order_relaxed);
+        tail.store(0, memory_order_relaxed);
+    }
+
+    ~Ring(){
+        delete[] cells;
+    }
+
+    bool tryPush(const T& value){
+        size_t pos = head.load(memory_order_relaxed);
+        while (true){
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.seq.load(memory_order_acquire);
+            if (seq == pos){
+                if (head.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)){
+                    cell.value = value;
+                    cell.seq.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (seq < pos){
+                return false;   // full
+            }
+            else {
+                pos = head.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    bool tryPop(T& value){
+        size_t pos = tail.load(memory_order_relaxed);
+        while (true){
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.seq.load(memory_order_acquire);
+            if (seq == pos + 1){
+                if (tail.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)){
+                    value = cell.value;
+                    cell.seq.store(pos + mask + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (seq < pos + 1){
+                return false;   // empty
+            }
+            else {
+                pos = tail.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    // Blocking versions: spin for a while, then yield, then sleep, so an idle stage (a worker
+    // waiting behind one huge test case) does not keep a core busy.
+    static void backoff(int& spins){
+        if (spins < 64){
+            spins++;
+        }
+        else if (spins < 256){
+            spins++;
+            this_thread::yield();
+        }
+        else {
+            this_thread::sleep_for(chrono::microseconds(50));
+        }
+    }
+
+    void push(const T& value){
+        int spins = 0;
+        while (!tryPush(value)) backoff(spins);
+    }
+
+    T pop(){
+        T value;
+        int spins = 0;
+        while (!tryPop(value)) backoff(spins);
+        return value;
+    }
+};
+
+/*
+Pipeline for --jobs N: the main thread parses, N workers simulate and one writer thread writes, so
+reading the input, simulating and writing the output all overlap. The stages only talk through
+Rings of Job pointers:
+    idle  (writer -> parser)    Jobs ready to be parsed into again,
+    work  (parser -> workers)   parsed test cases,
+    done  (workers -> writer)   simulated test cases, in completion order.
+There are exactly `window` Jobs, which bounds the memory held by parsed test cases and pending
+output; every Ring can hold all of them plus the stop markers, so a push never waits. Each Job keeps its TestCase and
+its in-memory Outputs, so arenas and buffers are reused from one test case to the next. The writer
+puts finished Jobs back in test number order (slot testNumber % window), so the output is byte for
+byte the one of a serial run. A null Job tells a worker to stop, and the worker passes it on so the
+writer knows when every worker is done.
+*/
+struct WorkerPool {
+    struct Job {
+        int testNumber;
+        TestCase tc;
+        Output result;
+        GanttTrace trace;
+        Output statsLine;
+
+        Job() : result(Output::MEMORY, 1 << 16), trace(Output::MEMORY, 1 << 12), statsLine(Output::MEMORY, 1 << 9){
+            this->testNumber = 0;
+        }
+    };
+
+    vector<thread> workers;
+    thread writer;
+    vector<Job*> all;
+    Ring<Job*> idle;
+    Ring<Job*> work;
+    Ring<Job*> done;
+    size_t window;
+    Output& out;
+    GanttTrace* trace;   // jobs trace into their own buffer, appended here in order
+    Output* stats;       // --stats output, nullptr without
+
+    WorkerPool(int workerCount, Output& out, GanttTrace* trace, Output* stats)
+        : idle(4 * (size_t)workerCount), work(5 * (size_t)workerCount), done(5 * (size_t)workerCount),
+          out(out){
+        this->window = 4 * (size_t)workerCount;
+        this->trace = trace;
+        this->stats = stats;
+        for (size_t j = 0; j < window; j++){
+            all.push_back(new Job());
+            idle.push(all.back());
+        }
+        for (int w = 0; w < workerCount; w++){
+            workers.emplace_back([this](){ simulate(); });
+        }
+        writer = thread([this, workerCount](){ write(workerCount); });
+    }
+
+    // Stops the workers once every submitted test case is simulated and waits for the writer.
+    ~WorkerPool(){
+        for (size_t w = 0; w < workers.size(); w++){
+            work.push(nullptr);
+        }
+        for (thread& t : workers){
+            t.join();
+        }
+        writer.join();
+        for (Job* job : all){
+            delete job;
+        }
+    }
+
+    // Hands out a Job whose TestCase the main thread parses into; waits while all are in flight.
+    Job* acquire(){
+        return idle.pop();
+    }
+
+    void submit(Job* job, int testNumber){
+        job->testNumber = testNumber;
+        work.push(job);
+    }
+
+    void simulate(){
+        while (true){
+            Job* job = work.pop();
+            if (job == nullptr){
+                done.push(nullptr);
+                return;
+            }
+            TestCase* tc = &job->tc;
+            tc->trace = trace ? &job->trace : nullptr;
+            STAT_TIME(tc->stats, runNs, runTestCase(job->testNumber, tc, job->result));
+            if (stats){
+                writeStats(job->statsLine, job->testNumber, tc->algorithm, tc->size, tc->decisions, tc->stats);
+            }
+            done.push(job);
+        }
+    }
+
+    // Writes finished jobs in test number order until every worker has stopped.
+    void write(int workerCount){
+        vector<Job*> finished(window, nullptr);
+        int next = 1;
+        int stopped = 0;
+        while (stopped < workerCount){
+            Job* job = done.pop();
+            if (job == nullptr){
+                stopped++;
+                continue;
+            }
+            finished[job->testNumber % window] = job;
+            while (finished[next % window] != nullptr && finished[next % window]->testNumber == next){
+                job = finished[next % window];
+                finished[next % window] = nullptr;
+                out.write(job->result.buffer, job->result.size);
+                out.flush();
+                if (trace){
+                    trace->append(job->trace);
+                    trace->flush();
+                }
+                if (stats){
+                    stats->write(job->statsLine.buffer, job->statsLine.size);
+                    stats->flush();
+                }
+                job->result.clear();
+                job->trace.data.clear();
+                job->trace.lastEnd = 0;
+                job->statsLine.clear();
+                idle.push(job);
+                next++;
+            }
+        }
+    }
+};
+
+/*
+Streaming mode (--stream). Test cases are simulated while they are being read: a process is only
+parsed once the simulation needs to know the next arrival, Gantt segments go to the Output as soon
+as they are decided, and the metrics are kept as running sums. Memory is proportional to the
+number of processes that have arrived and not finished, not to the size of the test case.
+
+Differences from the normal mode:
+  - the processes of a test case must be sorted by arrival time (an error is reported otherwise),
+  - only the totals and averages are printed, not the per-process waiting/turnaround/response lists
+    (with --summary, the percentiles too),
+  - a process count of -1 reads processes until the end of the input (last test case only).
+*/
+struct StreamProcess {
+    long long id;
+    Time arrival;
+    Time burst;
+    int nice;
+};
+
+/*
+Process table of a streamed test case, the TestCase's own ProcessTable pointed at arrays that only
+hold the processes that have arrived and not finished, so the ready queues and Policy traits work
+on it unchanged. An admitted process takes the next unused index and the arrays double when they
+are full. Once at least half of the used indices belong to finished processes, compactIfSparse()
+renumbers the live ones 0, 1, ... in the order they had, so the queues' index tie-breaks still
+follow the ids. The metric arrays are not used.
+*/
+struct StreamTable {
+    static const int MIN_CAPACITY = 1024;
+    ProcessTable& t;         // t.size is the capacity
+    vector<Time> arrival, burst, remaining, start_time;
+    vector<int> nice;
+    vector<long long> ids;
+    vector<char> live;
+    int used;                // indices handed out
+    int liveCount;
+
+    StreamTable(ProcessTable& t) : t(t){
+        this->t = ProcessTable();
+        this->used = 0;
+        this->liveCount = 0;
+        resize(MIN_CAPACITY);
+    }
+
+    void resize(int capacity){
+        arrival.resize(capacity);
+        burst.resize(capacity);
+        remaining.resize(capacity);
+        start_time.resize(capacity);
+        nice.resize(capacity);
+        ids.resize(capacity);
+        live.resize(capacity);
+        t.size = capacity;
+        t.arrival = arrival.data();
+        t.burst = burst.data();
+        t.remaining = remaining.data();
+        t.nice = nice.data();
+        t.start_time = start_time.data();
+    }
+
+    // Writes p to the first unused index without admitting it, so that it can already be
+    // compared with the admitted processes; admit() makes it live.
+    int place(const StreamProcess& p){
+        if (used == t.size){
+            resize(2 * t.size);
+        }
+        int i = used;
+        t.arrival[i] = p.arrival;
+        t.burst[i] = p.burst;
+        t.remaining[i] = p.burst;
+        t.nice[i] = p.nice;
+        t.start_time[i] = -1;
+        ids[i] = p.id;
+        return i;
+    }
+
+    int admit(const StreamProcess& p){
+        int i = place(p);
+        live[i] = true;
+        used++;
+        liveCount++;
+        return i;
+    }
+
+    void finish(int p){
+        live[p] = false;
+        liveCount--;
+    }
+
+    // Only valid while every live process is in queue.
+    template <typename Queue>
+    void compactIfSparse(Queue& queue){
+        if (used < MIN_CAPACITY || 2 * liveCount > used) return;
+        vector<int> to(used, -1);
+        int next = 0;
+        for (int i = 0; i < used; i++){
+            if (!live[i]) continue;
+            to[i] = next;
+            t.arrival[next] = t.arrival[i];
+            t.burst[next] = t.burst[i];
+            t.remaining[next] = t.remaining[i];
+            t.nice[next] = t.nice[i];
+            t.start_time[next] = t.start_time[i];
+            ids[next] = ids[i];
+            live[next] = true;
+            next++;
+        }
+        queue.renumber(to.data());
+        used = next;
+    }
+};
+
+/*
+Pulls the processes of one test case out of the input one at a time, keeping one lookahead.
+*/
+struct StreamSource {
+    InputReader& in;
+    long long count;     // processes in the test case, -1 for "until end of input"
+    long long readSoFar;
+    bool has;            // next holds a process that has not been admitted yet
+    StreamProcess next;
+    TimeSpan span;       // of the processes read so far
+
+    StreamSource(InputReader& in, long long count) : in(in){
+        this->count = count;
+        this->readSoFar = 0;
+        this->has = false;
+        this->next.arrival = TIME_MIN;
+        advance();
+    }
+
+    void advance(){
+        if (count >= 0 ? readSoFar == count : !in.nextToken()){
+            has = false;
+            return;
+        }
+        readSoFar++;
+        in.contextProcess = readSoFar;
+        Time previous = next.arrival;
+        next.id = readSoFar;
+        next.arrival = in.readInt("arrival time", TIME_MIN, TIME_MAX);
+        next.burst = in.readInt("burst time", 0, TIME_MAX);
+        next.nice = in.readInt("nice level", INT_MIN, INT_MAX);
+        if (!span.add(next.arrival, next.burst)){
+            in.fail(timeOverflow(in.contextTest));
+        }
+        if (readSoFar > 1 && next.arrival < previous){
+            in.fail("--stream needs processes sorted by arrival time, got " + to_string(next.arrival)
+                    + " after " + to_string(previous));
+        }
+        has = true;
+    }
+};
+
+/*
+Arrival source of simulate() for a streamed test case (see SortedArrivals): the arrival order is
+the input order, so the next arrival is the source's lookahead. A process is copied into the
+StreamTable when it is admitted and leaves it when it finishes, after adding to the running sums
+that replace the per-process metrics.
+*/
+struct StreamArrivals {
+    StreamSource& src;
+    StreamTable& table;
+    bool summary;
+    long long completed = 0;
+    long long totalBurst = 0;
+    long long totalTime = 0;
+    MetricSum sumWait = 0;
+    MetricSum sumTurn = 0;
+    MetricSum sumResp = 0;
+    // --summary: the same metrics as histograms, for the percentiles
+    LatencyHistogram waitHist, turnHist, respHist;
+
+    StreamArrivals(StreamSource& src, StreamTable& table, bool summary) : src(src), table(table){
+        this->summary = summary;
+    }
+
+    bool pending() const { return src.has; }
+    Time next() const { return src.next.arrival; }
+    int peek(){ return table.place(src.next); }
+    long long id(int p) const { return table.ids[p]; }
+    template <typename Queue> void settle(Queue& queue){ table.compactIfSparse(queue); }
+    // streamed test cases are never snapshotted
+    template <typename State> void save(State&) const {}
+
+    int admit(){
+        int p = table.admit(src.next);
+        src.advance();
+        return p;
+    }
+
+    void finish(int p, Time time){
+        const ProcessTable& t = table.t;
+        completed++;
+        totalBurst += t.burst[p];
+        totalTime = max(totalTime, (long long)time);
+        long long turnaround = (long long)time - t.arrival[p];
+        long long response = (long long)t.start_time[p] - t.arrival[p];
+        sumTurn += turnaround;
+        sumWait += turnaround - t.burst[p];
+        sumResp += response;
+        if (summary){
+            waitHist.record(turnaround - t.burst[p]);
+            turnHist.record(turnaround);
+            respHist.record(response);
+        }
+        table.finish(p);
+    }
+
+    // The totals and averages, in place of printResults.
+    void print(Output& out) const {
+        int cpuUtil = (int)((double)totalBurst / totalTime * 100);
+        double throughput = (double)completed / totalTime;
+        out << "Total time elapsed: " << totalTime << "ns" << '\n';
+        out << "Total CPU burst time: " << totalBurst << "ns" << '\n';
+        out << "CPU Utilization: " << cpuUtil << "%" << '\n';
+        out << "Throughput: " << throughput << " processes/ns" << '\n';
+        if (summary){
+            waitHist.print(out, "waiting");
+            turnHist.print(out, "turnaround");
+            respHist.print(out, "response");
+            return;
+        }
+        out << "Average waiting time: " << (double)sumWait / completed << "ns" << '\n';
+        out << "Average turnaround time: " << (double)sumTurn / completed << "ns" << '\n';
+        out << "Average response time: " << (double)sumResp / completed << "ns" << '\n';
+    }
+};
+
+// Runs a streamed test case through simulate() and returns how many processes finished.
+template <typename Policy>
+long long streamPolicy(int testNumber, TestCase* tc, StreamSource& src, Output& out){
+    out << testNumber << " " << tc->algorithm << '\n';
+    GanttWriter gantt(out, tc->trace, tc->options);
+    StreamTable table(tc->procs);
+    StreamArrivals arrivals(src, table, tc->options.summary);
+    EngineState<Policy> state(&tc->procs);
+    simulate<Policy>(tc, arrivals, state, gantt, nullptr);
+    gantt.finish();
+    arrivals.print(out);
+    return arrivals.completed;
+}
+
+/*
+Runs one streamed test case, whose algorithm, quantum and options are already in tc. tc only
+provides the settings, the counters and the process table StreamTable manages.
+*/
+long long runStreaming(int testNumber, TestCase* tc, StreamSource& src, Output& out){
+    if (tc->trace){
+        tc->trace->testCase(testNumber, tc->algorithm);
+    }
+    if (tc->algorithm == "FCFS"){
+        return streamPolicy<FCFSPolicy>(testNumber, tc, src, out);
+    } else if (tc->algorithm == "SJF"){
+        return streamPolicy<SJFPolicy>(testNumber, tc, src, out);
+    } else if (tc->algorithm == "SRTF"){
+        return streamPolicy<SRTFPolicy>(testNumber, tc, src, out);
+    } else if (tc->algorithm == "P"){
+        return streamPolicy<PrioPolicy>(testNumber, tc, src, out);
+    }
+    return streamPolicy<RoundRobinPolicy>(testNumber, tc, src, out);
+}
+
+/*
+Seeded random source for the workload generator. splitmix64 plus hand-written transforms are
+used instead of the <random> distributions, whose output differs between standard libraries,
+so a given seed produces the same workload in every build.
+*/
+struct Random {
+    unsigned long long state;
+
+    Random(unsigned long long seed){
+        this->state = seed;
+    }
+
+    unsigned long long next(){
+        unsigned long long z = (state += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    // Uniform in [0, 1).
+    double uniform(){
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    /*
+    Draws a value with the given mean from one of the supported distributions:
+      uniform      flat on [0, 2*mean]
+      exponential  memoryless, the usual model for independent arrivals
+      heavy        Pareto with alpha = 1.5, a few huge values among many small ones
+      bursty       mostly tiny values with occasional long gaps (on/off traffic)
+    */
+    double draw(const string& distribution, double mean){
+        double u = uniform();
+        if (distribution == "exponential"){
+            return -log(1.0 - u) * mean;
+        }
+        if (distribution == "heavy"){
+            const double alpha = 1.5;
+            double scale = mean * (alpha - 1) / alpha;
+            return scale / pow(1.0 - u, 1.0 / alpha);
+        }
+        if (distribution == "bursty"){
+            // 90% of draws average a twentieth of the mean, the other 10% make up the difference.
+            if (uniform() < 0.9){
+                return u * mean / 10;
+            }
+            return u * 2 * (mean - 0.9 * mean / 20) / 0.1;
+        }
+        return u * 2 * mean;
+    }
+};
+
+bool isDistribution(const string& name){
+    return name == "uniform" || name == "exponential" || name == "heavy" || name == "bursty";
+}
+
+/*
+Parameters of a synthetic test case: arrivals are a running sum of inter-arrival gaps drawn from
+`arrivals`, bursts are drawn from `bursts` (and are at least 1), nice levels are uniform in
+[0, niceLevels).
+*/
+struct WorkloadSpec {
+    string algorithm = "FCFS";
+    int quantum = 10;
+    int n = 1000;
+    string arrivals = "exponential";
+    string bursts = "exponential";
+    double meanGap = 50;
+    double meanBurst = 100;
+    int niceLevels = 40;
+    unsigned long long seed = 1;
+};
+
+// Fills tc with a workload; false if its clock could overflow Time or, for CFS, it is longer than
+// CFS_MAX_TOTAL_BURST (the checks the parser makes).
+bool generateWorkload(const WorkloadSpec& spec, Random& rng, TestCase* tc){
+    tc->reset(spec.n, spec.algorithm);
+    tc->quantum = spec.quantum;
+    double arrival = 0;
+    for (int i = 0; i < spec.n; i++){
+        if (i > 0){
+            arrival += spec.arrivals == "none" ? 0 : rng.draw(spec.arrivals, spec.meanGap);
+        }
+        Time burst = 1 + (Time)min(rng.draw(spec.bursts, spec.meanBurst), (double)TIME_MAX / 4);
+        int nice = (int)(rng.next() % spec.niceLevels);
+        Time at = (Time)min(arrival, (double)TIME_MAX / 2);
+        if (!tc->span.add(at, burst)){
+            return false;
+        }
+        tc->procs.set(i, at, burst, nice);
+    }
+    return spec.algorithm != "CFS" || tc->span.totalBurst <= CFS_MAX_TOTAL_BURST;
+}
+
+// gen's and bench's message for a workload generateWorkload refused.
+string workloadOverflow(int testNumber, const WorkloadSpec& spec, const TestCase& tc){
+    bool cfs = spec.algorithm == "CFS" && tc.span.totalBurst > CFS_MAX_TOTAL_BURST;
+    return (cfs ? cfsOverflow(testNumber) : timeOverflow(testNumber)) + " (use a smaller --n, --mean-gap or --mean-burst)";
+}
+
+// Reads the workload flags shared by the gen and bench modes, returns false if arg is not one of them.
+bool parseWorkloadFlag(WorkloadSpec& spec, int& a, int argc, char** argv){
+    string arg = argv[a];
+    if (a + 1 >= argc) return false;
+    if (arg == "--seed") spec.seed = strtoull(argv[++a], nullptr, 10);
+    else if (arg == "--arrivals") spec.arrivals = argv[++a];
+    else if (arg == "--bursts") spec.bursts = argv[++a];
+    else if (arg == "--mean-gap") spec.meanGap = atof(argv[++a]);
+    else if (arg == "--mean-burst") spec.meanBurst = atof(argv[++a]);
+    else if (arg == "--nice-levels") spec.niceLevels = max(1, atoi(argv[++a]));
+    else if (arg == "--quantum") spec.quantum = max(1, atoi(argv[++a]));
+    else return false;
+    return true;
+}
+
+/*
+gen mode: writes a synthetic input file in the usual format.
+    program gen [--tests T] [--n N] [--alg ALG] [workload flags]
+*/
+int generateMain(int argc, char** argv){
+    WorkloadSpec spec;
+    int tests = 1;
+    bool valid = true;
+    for (int a = 1; a < argc && valid; a++){
+        string arg = argv[a];
+        if (parseWorkloadFlag(spec, a, argc, argv)) continue;
+        if (arg == "--tests" && a + 1 < argc) tests = atoi(argv[++a]);
+        else if (arg == "--n" && a + 1 < argc) spec.n = atoi(argv[++a]);
+        else if (arg == "--alg" && a + 1 < argc) spec.algorithm = argv[++a];
+        else valid = false;
+    }
+    // the same limits readTestCase puts on the file this writes
+    if (!valid || tests < 0 || spec.n < 0 || !isAlgorithm(spec.algorithm)){
+        cerr << "usage: " << argv[0] << " [--tests T] [--n N] [--alg FCFS|SJF|SRTF|P|RR|CFS|MLFQ] [--quantum Q]"
+             << " [--arrivals D] [--bursts D] [--mean-gap G] [--mean-burst B] [--nice-levels L] [--seed S]" << endl
+             << "  T and N are at least 0, D is one of uniform, exponential, heavy, bursty (--arrivals also takes none)"
+             << endl;
+        return 1;
+    }
+    if ((!isDistribution(spec.arrivals) && spec.arrivals != "none") || !isDistribution(spec.bursts)){
+        cerr << "unknown distribution" << endl;
+        return 1;
+    }
+
+    Random rng(spec.seed);
+    TestCase tc;
+    Output out(1);
+    out << tests << '\n';
+    for (int t = 0; t < tests; t++){
+        if (!generateWorkload(spec, rng, &tc)){
+            cerr << "gen: " << workloadOverflow(t+1, spec, tc) << endl;
+            return 1;
+        }
+        out << spec.n << ' ' << spec.algorithm;
+        if (spec.algorithm == "RR"){
+            out << ' ' << spec.quantum;
+        }
+        out << '\n';
+        for (int i = 0; i < spec.n; i++){
+            out << tc.procs.arrival[i] << ' ' << tc.procs.burst[i] << ' ' << tc.procs.nice[i] << '\n';
+        }
+    }
+    return 0;
+}
+
+struct BenchResult {
+    double seconds;
+    long long decisions;
+    long peakRssKB;
+};
+
+/*
+Runs one benchmark configuration in a forked child so that its peak RSS is measured on its own.
+seconds is negative if the child failed, for instance because the workload would overflow Time.
+The workload is generated before the clock starts, and the run has no Gantt chart and only the
+--summary totals, so what is timed is the simulation rather than formatting its output. The best
+of `repeats` runs is reported.
+*/
+BenchResult benchOne(const WorkloadSpec& spec, int repeats){
+    int fds[2];
+    if (pipe(fds) != 0){
+        perror("pipe");
+        exit(1);
+    }
+    pid_t child = fork();
+    if (child < 0){
+        perror("fork");
+        exit(1);
+    }
+    if (child == 0){
+        close(fds[0]);
+        BenchResult result = {1e300, 0, 0};
+        TestCase tc;
+        tc.options.gantt = false;
+        tc.options.summary = true;
+        for (int r = 0; r < repeats; r++){
+            Random rng(spec.seed);
+            if (!generateWorkload(spec, rng, &tc)){
+                cerr << "bench: " << spec.algorithm << " n=" << spec.n << ": " << workloadOverflow(1, spec, tc) << ", skipped" << endl;
+                _exit(2);
+            }
+            Output out(Output::DISCARD, 1 << 16);
+            auto start = chrono::steady_clock::now();
+            runTestCase(1, &tc, out);
+            double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            result.seconds = min(result.seconds, elapsed);
+            result.decisions = tc.decisions;
+        }
+        Output::writeAll(fds[1], (const char*)&result, sizeof(result));
+        _exit(0);
+    }
+    close(fds[1]);
+    BenchResult result = {0, 0, 0};
+    bool received = read(fds[0], &result, sizeof(result)) == (ssize_t)sizeof(result);
+    close(fds[0]);
+    int status;
+    struct rusage usage;
+    wait4(child, &status, 0, &usage);
+    result.peakRssKB = usage.ru_maxrss;
+    if (!received){
+        // exit status 2 is a workload generateWorkload refused, which the child reported
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 2){
+            cerr << "benchmark child for " << spec.algorithm << " n=" << spec.n << " failed" << endl;
+        }
+        result.seconds = -1;
+    }
+    return result;
+}
+
+vector<string> splitList(const string& list){
+    vector<string> items;
+    size_t start = 0;
+    while (start <= list.size()){
+        size_t comma = list.find(',', start);
+        if (comma == string::npos) comma = list.size();
+        if (comma > start) items.push_back(list.substr(start, comma - start));
+        start = comma + 1;
+    }
+    return items;
+}
+
+/*
+bench mode: runs every algorithm over a grid of process counts and distributions and reports
+ns per scheduling decision and peak RSS. A table goes to stderr, JSON to stdout or --json FILE.
+    program bench [--algs A,B] [--n N1,N2] [--dists D1,D2] [--quanta Q1,Q2] [--repeats R] [--json FILE]
+The distribution is used for both arrivals and bursts unless --arrivals/--bursts pin one of them.
+*/
+int benchMain(int argc, char** argv){
+    WorkloadSpec base;
+    vector<string> algorithms = {"FCFS", "SJF", "SRTF", "P", "RR"};
+    vector<string> sizes = {"1000", "10000", "100000"};
+    vector<string> distributions = {"uniform", "exponential", "heavy", "bursty"};
+    vector<string> quanta = {"10"};
+    string fixedArrivals, fixedBursts;
+    int repeats = 3;
+    string jsonPath;
+    bool valid = true;
+    for (int a = 1; a < argc && valid; a++){
+        string arg = argv[a];
+        if (a + 1 < argc && arg == "--arrivals") fixedArrivals = argv[++a];
+        else if (a + 1 < argc && arg == "--bursts") fixedBursts = argv[++a];
+        else if (parseWorkloadFlag(base, a, argc, argv)) continue;
+        else if (arg == "--algs" && a + 1 < argc) algorithms = splitList(argv[++a]);
+        else if (arg == "--n" && a + 1 < argc) sizes = splitList(argv[++a]);
+        else if (arg == "--dists" && a + 1 < argc) distributions = splitList(argv[++a]);
+        else if (arg == "--quanta" && a + 1 < argc) quanta = splitList(argv[++a]);
+        else if (arg == "--repeats" && a + 1 < argc) repeats = max(1, atoi(argv[++a]));
+        else if (arg == "--json" && a + 1 < argc) jsonPath = argv[++a];
+        else valid = false;
+    }
+    for (const string& algorithm : algorithms){
+        valid = valid && isAlgorithm(algorithm);
+    }
+    for (const string& size : sizes){
+        valid = valid && atoi(size.c_str()) >= 0;
+    }
+    if (!valid){
+        cerr << "usage: " << argv[0] << " [--algs A,B] [--n N1,N2] [--dists D1,D2] [--quanta Q1,Q2]"
+             << " [--repeats R] [--json FILE] [workload flags as for gen]" << endl
+             << "  A is one of FCFS, SJF, SRTF, P, RR, CFS, MLFQ and every N is at least 0" << endl;
+        return 1;
+    }
+    for (const string& d : distributions){
+        if (!isDistribution(d)){
+            cerr << "unknown distribution " << d << endl;
+            return 1;
+        }
+    }
+
+    Output json(jsonPath.empty() ? 1 : open(jsonPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+    if (json.fd < 0){
+        perror(jsonPath.c_str());
+        return 1;
+    }
+    json << "{\"seed\": " << (long long)base.seed << ", \"repeats\": " << repeats << ", \"results\": [";
+    fprintf(stderr, "%-5s %4s %-12s %9s %12s %10s %12s %10s\n",
+            "alg", "q", "dist", "n", "decisions", "ms", "ns/decision", "rss KB");
+
+    bool first = true, skipped = false;
+    for (const string& algorithm : algorithms){
+        for (const string& q : (algorithm == "RR" ? quanta : vector<string>{"0"})){
+            for (const string& d : distributions){
+                for (const string& size : sizes){
+                    WorkloadSpec spec = base;
+                    spec.algorithm = algorithm;
+                    spec.quantum = max(1, atoi(q.c_str()));
+                    spec.n = atoi(size.c_str());
+                    spec.arrivals = fixedArrivals.empty() ? d : fixedArrivals;
+                    spec.bursts = fixedBursts.empty() ? d : fixedBursts;
+                    BenchResult r = benchOne(spec, repeats);
+                    if (r.seconds < 0){
+                        skipped = true;
+                        continue;
+                    }
+                    double nsPerDecision = r.decisions > 0 ? r.seconds * 1e9 / r.decisions : 0;
+                    fprintf(stderr, "%-5s %4s %-12s %9d %12lld %10.3f %12.2f %10ld\n", algorithm.c_str(),
+                            algorithm == "RR" ? q.c_str() : "-", d.c_str(), spec.n, r.decisions,
+                            r.seconds * 1e3, nsPerDecision, r.peakRssKB);
+                    json << (first ? "\n" : ",\n") << "  {\"algorithm\": \"" << algorithm << "\", \"quantum\": "
+                         << (algorithm == "RR" ? spec.quantum : 0) << ", \"arrivals\": \"" << spec.arrivals
+                         << "\", \"bursts\": \"" << spec.bursts << "\", \"n\": " << spec.n
+                         << ", \"decisions\": " << r.decisions << ", \"seconds\": " << r.seconds
+                         << ", \"ns_per_decision\": " << nsPerDecision << ", \"peak_rss_kb\": "
+                         << (long long)r.peakRssKB << "}";
+                    first = false;
+                }
+            }
+        }
+    }
+    json << "\n]}\n";
+    return skipped ? 1 : 0;
+}
+
+/*
+"trace FILE" mode: turns a binary trace written with --trace back into the text Gantt lines of a
+normal run, i.e. every "n ALG" heading, the "CPU k:" headings of a --cpus run and one
+"start pid duration[X]" line per segment. The trace is memory-mapped and decoded in place.
+*/
+int traceMain(int argc, char** argv){
+    if (argc != 2){
+        cerr << "usage: " << argv[0] << " FILE" << endl;
+        return 1;
+    }
+    int fd = open(argv[1], O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0){
+        perror(argv[1]);
+        return 1;
+    }
+    size_t len = st.st_size;
+    const unsigned char* data = nullptr;
+    if (len > 0){
+        void* mapped = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped == MAP_FAILED){
+            perror(argv[1]);
+            return 1;
+        }
+        madvise(mapped, len, MADV_SEQUENTIAL);
+        data = (const unsigned char*)mapped;
+    }
+    if (len < 8 || memcmp(data, GanttTrace::MAGIC, 8) != 0){
+        cerr << argv[1] << ": not a Gantt trace" << endl;
+        return 1;
+    }
+
+    size_t pos = 8;
+    // Reads one varint, false if the trace ends in the middle of it.
+    auto varint = [&](unsigned long long& value){
+        value = 0;
+        for (int shift = 0; pos < len && shift < 64; shift += 7){
+            unsigned char byte = data[pos++];
+            value |= (unsigned long long)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return false;
+    };
+
+    Output out(1);
+    long long lastEnd = 0;
+    while (pos < len){
+        size_t recordStart = pos;
+        unsigned long long head, a, b;
+        bool ok = varint(head);
+        long long value = head >> 2;
+        int kind = head & 3;
+        if (ok && kind <= 1){
+            ok = varint(a) && varint(b);
+            if (ok){
+                long long start = lastEnd + (long long)(value >> 1 ^ -(value & 1));
+                writeSegment(out, nullptr, start, a, b, kind == 1);
+                lastEnd = start + b;
+            }
+        }
+        else if (ok && kind == 2){
+            ok = varint(a) && a <= len - pos;
+            if (ok){
+                out << value << " ";
+                out.write((const char*)data + pos, a);
+                out << '\n';
+                pos += a;
+                lastEnd = 0;
+            }
+        }
+        else if (ok){
+            out << "CPU " << value << ":" << '\n';
+            lastEnd = 0;
+        }
+        if (!ok){
+            out.flush();
+            cerr << argv[1] << ": truncated record at byte " << recordStart << endl;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*
+Loads a --resume snapshot: positions the input after the test case it was taken in, cuts the output
+back to what was final at the time, and if a test case was being simulated, finishes it from the
+saved state. Returns how many test cases are done, or -1 if the snapshot cannot be used.
+*/
+int resumeSnapshot(const string& path, InputReader& in, Output& out, TestCase* tc, const SimOptions& options, int& numTests){
+    int fd = open(path.c_str(), O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) < 0){
+        perror(path.c_str());
+        return -1;
+    }
+    vector<char> data(st.st_size);
+    size_t filled = 0;
+    while (filled < data.size()){
+        ssize_t r = ::read(fd, data.data() + filled, data.size() - filled);
+        if (r <= 0){
+            perror(path.c_str());
+            return -1;
+        }
+        filled += r;
+    }
+    close(fd);
+
+    SnapshotHeader h;
+    if (data.size() < sizeof h || memcmp(data.data(), SnapshotHeader::MAGIC, 8) != 0){
+        cerr << path << ": not a snapshot" << endl;
+        return -1;
+    }
+    memcpy(&h, data.data(), sizeof h);
+    if (h.running && h.timeBits != SCHED_TIME_BITS){
+        cerr << path << ": snapshot was taken by a build with " << h.timeBits << "-bit time" << endl;
+        return -1;
+    }
+    size_t expected = sizeof h + (h.running ? (size_t)h.size * 5 * sizeof(Time) + ((size_t)h.size + h.queueSize) * sizeof(int) : 0);
+    if (data.size() != expected || h.size < 0 || h.queueSize < 0){
+        cerr << path << ": truncated snapshot" << endl;
+        return -1;
+    }
+    if (h.inputSize != (long long)in.mappedSize || h.inputOffset > h.inputSize){
+        cerr << path << ": snapshot was taken with a different input" << endl;
+        return -1;
+    }
+    if (ftruncate(out.fd, h.outputOffset) < 0 || lseek(out.fd, h.outputOffset, SEEK_SET) < 0){
+        perror("output");
+        return -1;
+    }
+    in.cur = in.mapped + h.inputOffset;
+    in.line = h.inputLine;
+    numTests = h.numTests;
+    if (tc->snapshots != nullptr){
+        // the resumed test case can be snapshotted again
+        tc->snapshots->numTests = h.numTests;
+        tc->snapshots->testNumber = h.testNumber;
+        tc->snapshots->next = h.decisions + tc->snapshots->every;
+    }
+    if (!h.running){
+        return h.testNumber;
+    }
+
+    tc->reset(h.size, string(h.algorithm, strnlen(h.algorithm, sizeof h.algorithm)));
+    tc->quantum = h.quantum;
+    tc->options = options;
+    ProcessTable& t = tc->procs;
+    const char* arrays = data.data() + sizeof h;
+    Time* into[] = {t.arrival, t.burst, t.remaining, t.start_time, t.completion_time};
+    for (int k = 0; k < 5; k++){
+        memcpy(into[k], arrays, (size_t)h.size * sizeof(Time));
+        arrays += (size_t)h.size * sizeof(Time);
+    }
+    memcpy(t.nice, arrays, (size_t)h.size * sizeof(int));
+    const int* queueItems = (const int*)(arrays + (size_t)h.size * sizeof(int));
+    vector<int> queue(queueItems, queueItems + h.queueSize);
+
+    if (tc->algorithm == "FCFS"){
+        resumeEngine<FCFSPolicy>(h.testNumber, tc, out, h, queue);
+    } else if (tc->algorithm == "SJF"){
+        resumeEngine<SJFPolicy>(h.testNumber, tc, out, h, queue);
+    } else if (tc->algorithm == "SRTF"){
+        resumeEngine<SRTFPolicy>(h.testNumber, tc, out, h, queue);
+    } else if (tc->algorithm == "P"){
+        resumeEngine<PrioPolicy>(h.testNumber, tc, out, h, queue);
+    } else if (tc->algorithm == "RR"){
+        resumeEngine<RoundRobinPolicy>(h.testNumber, tc, out, h, queue);
+    } else {
+        cerr << path << ": unknown algorithm in snapshot" << endl;
+        return -1;
+    }
+    out.flush();
+    return h.testNumber;
+}
+
+int main(int argc, char** argv){
+    if (argc > 1 && string(argv[1]) == "trace"){
+        return traceMain(argc - 1, argv + 1);
+    }
+    if (argc > 1 && string(argv[1]) == "gen"){
+        return generateMain(argc - 1, argv + 1);
+    }
+    if (argc > 1 && string(argv[1]) == "bench"){
+        return benchMain(argc - 1, argv + 1);
+    }
+
+    // Input comes from stdin unless --input FILE is given.
+    // Results go to stdout unless --output FILE or --fd N points them somewhere else.
+    int inFd = 0;
+    int outFd = 1;
+    // Number of test cases simulated in parallel, see WorkerPool.
+    int jobs = 1;
+    // Simulate while reading, see runStreaming.
+    bool stream = false;
+    // Binary Gantt trace file instead of the text Gantt lines, see GanttTrace.
+    int traceFd = -1;
+    // --output is opened once the arguments are read, since --resume must not truncate it.
+    string outputPath;
+    // Snapshots of the running simulation and resuming from one, see Snapshotter.
+    string snapshotPath;
+    string resumePath;
+    long long snapshotEvery = 0;
+    // Where --stats sends its JSON lines, -1 for nowhere.
+    int statsFd = -1;
+    SimOptions options;
+    for (int a = 1; a < argc; a++){
+        string arg = argv[a];
+        if (arg == "--input" && a + 1 < argc){
+            inFd = open(argv[++a], O_RDONLY);
+            if (inFd < 0){
+                perror(argv[a]);
+                return 1;
+            }
+        }
+        else if (arg == "--output" && a + 1 < argc){
+            outputPath = argv[++a];
+        }
+        else if (arg == "--snapshot" && a + 1 < argc){
+            snapshotPath = argv[++a];
+        }
+        else if (arg == "--snapshot-every" && a + 1 < argc){
+            snapshotEvery = max(0LL, atoll(argv[++a]));
+        }
+        else if (arg == "--resume" && a + 1 < argc){
+            resumePath = argv[++a];
+        }
+        else if (arg == "--fd" && a + 1 < argc){
+            outFd = atoi(argv[++a]);
+        }
+        else if (arg == "--trace" && a + 1 < argc){
+            traceFd = open(argv[++a], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (traceFd < 0){
+                perror(argv[a]);
+                return 1;
+            }
+        }
+        else if (arg == "--stream"){
+            stream = true;
+        }
+        else if (arg == "--stats"){
+            statsFd = 2;
+        }
+        else if (arg == "--stats-file" && a + 1 < argc){
+            statsFd = open(argv[++a], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (statsFd < 0){
+                perror(argv[a]);
+                return 1;
+            }
+        }
+        else if (arg == "--summary"){
+            options.summary = true;
+        }
+        else if (arg == "--no-gantt"){
+            options.gantt = false;
+        }
+        else if (arg == "--gantt-merge"){
+            options.ganttMerge = true;
+        }
+        else if (arg == "--gantt-sample" && a + 1 < argc){
+            options.ganttSample = max(1LL, atoll(argv[++a]));
+        }
+        else if (arg == "--gantt-cap" && a + 1 < argc){
+            options.ganttCap = max(0LL, atoll(argv[++a]));
+        }
+        else if (arg == "--what-if" && a + 1 < argc){
+            // T:P:burst=V or T:P:nice=V
+            WhatIf change;
+            char field[8];
+            int used = 0;
+            if (sscanf(argv[++a], "%d:%d:%7[a-z]=%d%n", &change.test, &change.process, field, &change.value, &used) != 4
+                || argv[a][used] != '\0' || (strcmp(field, "burst") != 0 && strcmp(field, "nice") != 0)
+                || (strcmp(field, "burst") == 0 && change.value < 0)){
+                cerr << "bad --what-if '" << argv[a] << "', expected TEST:PROCESS:burst=V or TEST:PROCESS:nice=V" << endl;
+                return 1;
+            }
+            change.field = field;
+            options.whatIf.push_back(change);
+        }
+        else if (arg == "--cpus" && a + 1 < argc){
+            options.cpus = max(1, atoi(argv[++a]));
+        }
+        else if (arg == "--cfs-latency" && a + 1 < argc){
+            options.cfsLatency = max(1, atoi(argv[++a]));
+        }
+        else if (arg == "--cfs-granularity" && a + 1 < argc){
+            options.cfsGranularity = max(1, atoi(argv[++a]));
+        }
+        else if (arg == "--mlfq-levels" && a + 1 < argc){
+            options.mlfqLevels = min(max(1, atoi(argv[++a])), (int)MLFQLevels::MAX_LEVELS);
+        }
+        else if (arg == "--mlfq-quanta" && a + 1 < argc){
+            options.mlfqQuanta.clear();
+            for (const string& q : splitList(argv[++a])){
+                options.mlfqQuanta.push_back(max(1, atoi(q.c_str())));
+            }
+            if (options.mlfqQuanta.empty()){
+                options.mlfqQuanta.push_back(1);
+            }
+        }
+        else if (arg == "--mlfq-boost" && a + 1 < argc){
+            options.mlfqBoost = max(0, atoi(argv[++a]));
+        }
+        else if (arg == "--jobs" && a + 1 < argc){
+            jobs = atoi(argv[++a]);
+            if (jobs < 1){
+                jobs = thread::hardware_concurrency();
+            }
+        }
+        else {
+            cerr << "usage: " << argv[0] << " [--input FILE] [--output FILE | --fd N] [--trace FILE] [--summary]"
+                 << " [--no-gantt | --gantt-merge [--gantt-sample K] [--gantt-cap N]]"
+                 << " [--what-if T:P:burst=V|T:P:nice=V]..."
+                 << " [--snapshot FILE [--snapshot-every DECISIONS]] [--resume FILE]"
+                 << " [--stats | --stats-file FILE]"
+                 << " [--jobs N | --stream] [--cpus N]"
+                 << " [--cfs-latency NS] [--cfs-granularity NS]"
+                 << " [--mlfq-levels L] [--mlfq-quanta Q1,Q2,..] [--mlfq-boost NS]" << endl
+                 << "       " << argv[0] << " gen [options]    generate a synthetic input file" << endl
+                 << "       " << argv[0] << " bench [options]  benchmark the schedulers" << endl
+                 << "       " << argv[0] << " trace FILE       print a --trace file as text Gantt lines" << endl;
+            return 1;
+        }
+    }
+    if (!outputPath.empty()){
+        outFd = open(outputPath.c_str(), O_WRONLY | O_CREAT | (resumePath.empty() ? O_TRUNC : 0), 0644);
+        if (outFd < 0){
+            perror(outputPath.c_str());
+            return 1;
+        }
+    }
+    if (statsFd != -1 && !SCHED_STATS){
+        cerr << "--stats needs a build with SCHED_STATS=1" << endl;
+        return 1;
+    }
+    Output out(outFd);
+    Output statsFile(statsFd == -1 ? Output::DISCARD : statsFd, 1 << 12);
+    Output* stats = statsFd == -1 ? nullptr : &statsFile;
+    GanttTrace traceFile(traceFd == -1 ? Output::MEMORY : traceFd, traceFd == -1 ? 1 : Output::CAPACITY);
+    GanttTrace* trace = traceFd == -1 ? nullptr : &traceFile;
+    if (trace){
+        // written out right away, so even a run that fails before its first test case leaves a valid trace
+        trace->header();
+        trace->flush();
+    }
+
+    InputReader in(inFd);
+    bool snapshotting = !snapshotPath.empty() || !resumePath.empty();
+    if (snapshotting && (stream || jobs > 1 || options.cpus > 1 || trace || !options.whatIf.empty())){
+        cerr << "--snapshot and --resume cannot be combined with --stream, --jobs, --cpus, --trace or --what-if" << endl;
+        return 1;
+    }
+    if (snapshotting && (options.ganttMerge || options.ganttSample > 1 || options.ganttCap != LLONG_MAX)){
+        cerr << "--snapshot and --resume cannot be combined with --gantt-merge, --gantt-sample or --gantt-cap" << endl;
+        return 1;
+    }
+    if (snapshotting && (outputPath.empty() || in.mapped == nullptr)){
+        cerr << "--snapshot and --resume need a regular input file and --output FILE" << endl;
+        return 1;
+    }
+    Snapshotter snapshots(snapshotPath, snapshotEvery, &in, &out);
+    if (!snapshotPath.empty()){
+        struct sigaction action;
+        memset(&action, 0, sizeof action);
+        action.sa_handler = [](int received){ snapshotSignal = received; };
+        sigaction(SIGUSR1, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+    }
+
+    // Iterates through each test case, one TestCase (and its arena) is reused for all of them
+    TestCase testCase;
+    testCase.trace = trace;
+    testCase.snapshots = snapshotPath.empty() ? nullptr : &snapshots;
+    int num_test;
+    // test cases already in the output
+    int done = 0;
+    if (!resumePath.empty()){
+        done = resumeSnapshot(resumePath, in, out, &testCase, options, num_test);
+        if (done < 0) return 1;
+    } else {
+        num_test = in.readInt("number of test cases", 0, INT_MAX);
+    }
+    snapshots.numTests = num_test;
+
+    if (stream && options.cpus > 1){
+        cerr << "--stream only simulates a single CPU" << endl;
+        return 1;
+    }
+    if (stream && jobs > 1){
+        cerr << "--stream cannot be combined with --jobs, it simulates test cases in input order as they are read" << endl;
+        return 1;
+    }
+    if (!options.whatIf.empty() && (stream || options.cpus > 1 || trace)){
+        cerr << "--what-if cannot be combined with --stream, --cpus or --trace" << endl;
+        return 1;
+    }
+    if (stream){
+        for (int i = 0; i < num_test; i++){
+            string algorithm;
+            Time quantum, quantumLast, quantumStep;
+            long long count = readTestCaseHeader(in, i+1, i+1 == num_test ? -1 : 0, algorithm, quantum,
+                                                 quantumLast, quantumStep);
+            if (algorithm == "CFS" || algorithm == "MLFQ"){
+                in.fail(algorithm + " is not supported with --stream");
+            }
+            if (quantumStep > 0){
+                in.fail("quantum sweeps are not supported with --stream");
+            }
+            StreamSource source(in, count);
+            // only the settings and counters of testCase are used, runStreaming manages its process table
+            testCase.algorithm = algorithm;
+            testCase.quantum = quantum;
+            testCase.options = options;
+            testCase.decisions = 0;
+            testCase.stats = Stats();
+            long long completed;
+            STAT_TIME(testCase.stats, runNs, completed = runStreaming(i+1, &testCase, source, out));
+            STAT_TIME(testCase.stats, flushNs, out.flush());
+            if (trace){
+                trace->flush();
+            }
+            if (stats){
+                // parsing happens during the simulation, so it is part of simulate_ns
+                writeStats(*stats, i+1, algorithm, completed, testCase.decisions, testCase.stats);
+                stats->flush();
+            }
+        }
+        return 0;
+    }
+
+    if (jobs > 1){
+        {
+            WorkerPool pool(jobs, out, trace, stats);
+            for (int i = 0; i < num_test; i++){
+                WorkerPool::Job* job = pool.acquire();
+                STAT_TIME(job->tc.stats, parseNs, readTestCase(in, i+1, &job->tc, options));
+                pool.submit(job, i+1);
+            }
+        }
+        return 0;
+    }
+
+    for (int i = done; i < num_test; i++){
+        STAT_TIME(testCase.stats, parseNs, readTestCase(in, i+1, &testCase, options));
+        snapshots.testNumber = i+1;
+        STAT_TIME(testCase.stats, runNs, runTestCase(i+1, &testCase, out));
+        // Hand the finished test case to the OS in one go.
+        STAT_TIME(testCase.stats, flushNs, out.flush());
+        if (trace){
+            trace->flush();
+        }
+        if (stats){
+            writeStats(*stats, i+1, testCase.algorithm, testCase.size, testCase.decisions, testCase.stats);
+            stats->flush();
+        }
+        // a signal that came while no snapshot could be taken
+        if (testCase.snapshots != nullptr && snapshotSignal != 0){
+            snapshots.saveBetween();
+        }
     }
     
     return 0;